@@ -14,11 +14,11 @@ S_CLUBS
 
 struct Card
 {
-    Card():suit(0),value(0)
+    constexpr Card():suit(0),value(0)
     {
     }
 
-    Card(uint8_t suit, uint8_t value)
+    constexpr Card(uint8_t suit, uint8_t value)
     :suit(suit), 
     value(value)
     {
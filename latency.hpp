@@ -0,0 +1,96 @@
+#ifndef POKER_CONTRACT_LATENCY_H
+#define POKER_CONTRACT_LATENCY_H
+
+#include <stdint.h>
+#include <vector>
+
+// Histograms of players' decision times by phase, kept on the account and used for
+// TF_ADAPTIVE_TIMEOUT tables. No eosiolib in this file, clients and tools use it too.
+// Bucket 0 is less than 1 second, bucket b is [2^(b-1), 2^b) seconds, the last one is the rest.
+
+enum LatencyPhase
+{
+    L_SHUFFLE,
+    L_CRYPT,
+    L_ACT,
+    L_KEYS,
+    LATENCY_PHASES
+};
+
+#define LATENCY_BUCKETS         8
+#define LATENCY_SIZE            (LATENCY_PHASES * LATENCY_BUCKETS)
+#define LATENCY_MIN_SAMPLES     32      // less samples: no adaptive timeout for the player
+#define LATENCY_PERCENTILE      99
+#define ADAPTIVE_TIMEOUT_MIN_SEC 10
+
+inline uint8_t latencyBucket(uint64_t sec)
+{
+    uint8_t bucket = 0;
+    while(sec != 0 && bucket < LATENCY_BUCKETS - 1)
+    {
+        sec >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+// adds a hand of the player to the account histogram, halves the account one when a counter is full
+inline void addLatency(std::vector<uint16_t>& hist, const std::vector<uint8_t>& hand)
+{
+    if(hist.size() != LATENCY_SIZE)
+        hist.assign(LATENCY_SIZE, 0);
+
+    bool full = false;
+    for(size_t i = 0; i < LATENCY_SIZE && i < hand.size(); i++)
+        if(hist[i] + hand[i] > 0xFFFF)
+            full = true;
+
+    if(full)
+        for(uint16_t& count: hist)
+            count >>= 1;
+
+    for(size_t i = 0; i < LATENCY_SIZE && i < hand.size(); i++)
+        hist[i] += hand[i];
+}
+
+// twice the LATENCY_PERCENTILE time of the slowest phase, 0 if not enough samples
+// or the player is slower than the last bucket
+inline uint32_t getLatencyTimeout(const std::vector<uint16_t>& hist)
+{
+    if(hist.size() != LATENCY_SIZE)
+        return 0;
+
+    uint32_t timeout = 0;
+    uint32_t samples = 0;
+
+    for(int phase = 0; phase < LATENCY_PHASES; phase++)
+    {
+        const uint16_t* counts = &hist[phase * LATENCY_BUCKETS];
+        uint32_t total = 0;
+        for(int b = 0; b < LATENCY_BUCKETS; b++)
+            total += counts[b];
+
+        if(total == 0)
+            continue;
+        samples += total;
+
+        uint32_t sum = 0;
+        int bucket = 0;
+        while(bucket < LATENCY_BUCKETS - 1 && (sum + counts[bucket])*100 < (uint64_t)total*LATENCY_PERCENTILE)
+            sum += counts[bucket++];
+
+        if(bucket == LATENCY_BUCKETS - 1)
+            return 0;
+
+        uint32_t phase_timeout = 2u << bucket;
+        if(phase_timeout > timeout)
+            timeout = phase_timeout;
+    }
+
+    if(samples < LATENCY_MIN_SAMPLES)
+        return 0;
+
+    return timeout < ADAPTIVE_TIMEOUT_MIN_SEC ? ADAPTIVE_TIMEOUT_MIN_SEC : timeout;
+}
+
+#endif
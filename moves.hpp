@@ -0,0 +1,109 @@
+#ifndef POKER_CONTRACT_MOVES_H
+#define POKER_CONTRACT_MOVES_H
+
+#include <stdint.h>
+
+// Legal moves and bet sizes of the player to act, derived from the betting state.
+// The contract validates acts with it, clients list moves with it, so no eosiolib in this file.
+// Amounts are asset amounts of EOS_SYMBOL.
+
+enum ActTypes
+{
+    ACT_SMALL_BLIND,
+    ACT_BIG_BLIND,
+    ACT_BET, // includes CALL and RAISE // 2
+    ACT_FOLD,
+    ACT_CHECK,
+    ACT_NEW_ROUND,
+    // descriptions
+    ACT_CALL,
+    ACT_RISE, // 7
+    ACT_ALLIN
+};
+
+struct BettingState
+{
+    int64_t     small_blind = 0;
+    int64_t     current_bet = 0;
+    uint8_t     game_round = 0;
+
+    // the player to act
+    int64_t     stack = 0;
+    int64_t     cur_round_bets = 0;
+    uint8_t     count_of_acts = 0;
+    uint8_t     is_bb = 0;
+    uint8_t     extra_bb_status = 0;
+};
+
+inline int64_t maxBetValue(const BettingState& s)
+{
+    return s.stack + s.cur_round_bets;
+}
+
+inline int64_t minRaiseValue(const BettingState& s)
+{
+    return s.current_bet == 0 ? s.small_blind*2 : s.current_bet*2;
+}
+
+inline bool canCheck(const BettingState& s)
+{
+    if(s.current_bet == 0)
+        return true;
+
+    // preflop nobody raised: big blind or player who posted extra BB
+    if(s.game_round != 0 || s.current_bet != s.small_blind*2)
+        return false;
+
+    if(s.is_bb)
+        return s.count_of_acts == 1;
+
+    return s.extra_bb_status == 1 && s.cur_round_bets == s.current_bet;
+}
+
+// ACT_BET, ACT_FOLD or ACT_CHECK
+inline bool isPossibleMove(const BettingState& s, uint8_t act)
+{
+    switch(act)
+    {
+        case ACT_FOLD:
+        case ACT_BET:
+            return true;
+        case ACT_CHECK:
+            return canCheck(s);
+        default:
+            return false;
+    }
+}
+
+// ACT_BET value: all in, call, first bet in sb steps, or raise at least twice current bet
+inline bool isValidBet(const BettingState& s, int64_t bet)
+{
+    if(bet <= 0 || bet > maxBetValue(s))
+        return false;
+
+    if(bet == maxBetValue(s))
+        return true;
+
+    if(s.current_bet == 0)
+        return bet % s.small_blind == 0 && bet >= s.small_blind*2;
+
+    return bet == s.current_bet || bet >= s.current_bet*2;
+}
+
+// raise sizes offered to players: min raise in small blind steps, the last one is all in
+inline uint32_t raiseVariantsCount(const BettingState& s)
+{
+    int64_t max = maxBetValue(s);
+    int64_t min = minRaiseValue(s);
+    if(min >= max)
+        return 1;
+    return (uint32_t)((max - min + s.small_blind - 1)/s.small_blind) + 1;
+}
+
+inline int64_t raiseVariant(const BettingState& s, uint32_t index)
+{
+    int64_t variant = minRaiseValue(s) + s.small_blind*index;
+    return variant < maxBetValue(s) ? variant : maxBetValue(s);
+}
+
+#endif
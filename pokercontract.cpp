@@ -13,11 +13,11 @@
 #define MAX_INDEX_IN_COMBO  4
 #define COMBO_SIZE          5
 
-globalstate pokercontract::get_default_parameters()
+globalstate getDefaultParameters()
 {
         globalstate gs;
 
-        gs.version = 393;
+        gs.version = RAKE_BP_VERSION;
 
         gs.small_blind_values.push_back(eosio::asset(100, EOS_SYMBOL));
         gs.small_blind_values.push_back(eosio::asset(200, EOS_SYMBOL));
@@ -31,7 +31,7 @@ globalstate pokercontract::get_default_parameters()
         gs.max_penalty_value = eosio::asset(500000, EOS_SYMBOL);
         gs.player_pay_percent = 70;
         gs.master_pay_percent = 30;
-        gs.rake_percent = 3;
+        gs.rake_bp = 300;
         gs.max_rake_value = eosio::asset(50000, EOS_SYMBOL);
         gs.warning_timeout_sec = 25;
         gs.last_timeout_sec = 15;
@@ -45,12 +45,88 @@ globalstate pokercontract::get_default_parameters()
         return gs;
 }
 
+CONTRACT_STATE_STORAGE GlobalCache global_cache;
+
+void GlobalCache::reset()
+{
+    state.reset();
+    fine.reset();
+    ref.reset();
+    pool.reset();
+}
+
+bool GlobalCache::stateExists()
+{
+    getState();
+    return state_exists;
+}
+
+globalstate& GlobalCache::getState()
+{
+    if(!state.loaded)
+    {
+        name contractname(CONTRACTNAME);
+        global_state_singleton global(contractname,contractname.value);
+        state_exists = global.exists();
+        state.set(state_exists ? global.get() : getDefaultParameters());
+    }
+    return state.get();
+}
+
+globalfine& GlobalCache::getFine()
+{
+    if(!fine.loaded)
+    {
+        name contractname(CONTRACTNAME);
+        global_fine_singleton global_fine(contractname,contractname.value);
+        fine.set(global_fine.get_or_default(globalfine()));
+    }
+    return fine.get();
+}
+
+globalref& GlobalCache::getRef()
+{
+    if(!ref.loaded)
+    {
+        name contractname(CONTRACTNAME);
+        global_ref_singleton global_ref(contractname,contractname.value);
+        ref.set(global_ref.get_or_default(globalref()));
+    }
+    return ref.get();
+}
+
+globalpool& GlobalCache::getPool()
+{
+    if(!pool.loaded)
+    {
+        name contractname(CONTRACTNAME);
+        global_pool_singleton global_pool(contractname,contractname.value);
+        pool.set(global_pool.get_or_default(globalpool()));
+    }
+    return pool.get();
+}
+
+void GlobalCache::saveState(eosio::name payer)
+{
+    name contractname(CONTRACTNAME);
+    global_state_singleton global(contractname,contractname.value);
+    global.set(getState(), payer);
+    state_exists = true;
+}
+
+void GlobalCache::saveFine(eosio::name payer)
+{
+    name contractname(CONTRACTNAME);
+    global_fine_singleton global_fine(contractname,contractname.value);
+    global_fine.set(getFine(), payer);
+}
+
 ACTION pokercontract::setparams(eosio::name owner, globalstate& gs)
 {
     require_auth(owner);
     eosio_assert(owner == _self, "Only owner can run setparams");
 
-    globalstate gstate_for_version = get_default_parameters();
+    globalstate gstate_for_version = getDefaultParameters();
     globalstate gstate = global.get();
     gstate.version = gstate_for_version.version;
 
@@ -96,15 +172,10 @@ ACTION pokercontract::setparams(eosio::name owner, globalstate& gs)
 
     eosio_assert(gs.master_pay_percent + gs.player_pay_percent == 100, "sum of master_pay_percent and player_pay_percent must be 100");
 
-    eosio_assert(gs.rake_percent >= 0.1, "rake_percent must be greater or equal 0.1 and less or equal 5.0");
-    eosio_assert(gs.rake_percent <= 5.0, "rake_percent must be greater or equal 0.1 and less or equal 5.0");
-    gstate.rake_percent = gs.rake_percent;
-
-    double min_rake_percent = 0.1;
-    int n = (gs.rake_percent*10)/(min_rake_percent*10);
-    float check_rake_percent = n * min_rake_percent;
-
-    eosio_assert(check_rake_percent == gs.rake_percent, "rake_percent must be a multiple of 0.1");
+    eosio_assert(gs.rake_bp >= 10, "rake_bp must be greater or equal 10 and less or equal 500");
+    eosio_assert(gs.rake_bp <= 500, "rake_bp must be greater or equal 10 and less or equal 500");
+    eosio_assert(gs.rake_bp % 10 == 0, "rake_bp must be a multiple of 10");
+    gstate.rake_bp = gs.rake_bp;
 
     eosio_assert(gs.max_rake_value.symbol == EOS_SYMBOL, "wrong max_rake_value symbol");
     eosio_assert(gs.max_rake_value.amount > 0, "max_rake_value must be greater than 0");
@@ -136,6 +207,24 @@ ACTION pokercontract::setparams(eosio::name owner, globalstate& gs)
     global.set(gstate, owner);
 }
 
+// float rake_percent -> rake_bp, the only float math left in the contract
+ACTION pokercontract::migraterake(eosio::name owner)
+{
+    require_auth(owner);
+    eosio_assert(owner == _self, "Only owner can run migraterake");
+
+    global_state_legacy_singleton global_legacy(_self, _self.value);
+    eosio_assert(global_legacy.exists(), "globalstate doesn't exist");
+
+    globalstate_legacy legacy = global_legacy.get();
+    eosio_assert(legacy.version < RAKE_BP_VERSION, "rake is already in basis points");
+
+    globalstate gs = global.get(); // same layout, rake_bp has float bits yet
+    gs.rake_bp = (uint32_t)(legacy.rake_percent*100 + 0.5f);
+    gs.version = RAKE_BP_VERSION;
+    global.set(gs, owner);
+}
+
 ACTION pokercontract::setref(eosio::name owner, uint32_t percent)
 {
     require_auth(owner);
@@ -143,11 +232,43 @@ ACTION pokercontract::setref(eosio::name owner, uint32_t percent)
 
     eosio_assert(percent <= 100, "percent must be less or equal 100");
 
-    globalref gref = global_ref.get();
+    globalref gref = global_cache.getRef();
     gref.percent = percent;
     global_ref.set(gref, owner);
 }
 
+ACTION pokercontract::setpool(eosio::name owner, uint32_t pool_size)
+{
+    require_auth(owner);
+    eosio_assert(owner == _self, "Only owner can run setpool");
+
+    globalpool gpool = global_cache.getPool();
+    gpool.pool_size = pool_size;
+    global_pool_singleton(_self, _self.value).set(gpool, owner);
+}
+
+// creates parked tables of the small blind up to the pool size, so first joins don't emplace
+ACTION pokercontract::warmpool(eosio::name owner, eosio::asset small_blind, uint32_t count)
+{
+    require_auth(owner);
+    eosio_assert(owner == _self, "Only owner can run warmpool");
+    eosio_assert(global_cache.stateExists(), "globalstate is not initialized");
+
+    const globalstate& gstate = global_cache.getState();
+    auto itr_blind = std::find(gstate.small_blind_values.begin(), gstate.small_blind_values.end(), small_blind);
+    eosio_assert(itr_blind != gstate.small_blind_values.end(), "Wrong small blind value");
+
+    uint32_t pool_size = global_cache.getPool().pool_size;
+    uint32_t parked = parkedTablesCount(small_blind, pool_size);
+
+    for(; parked < pool_size && count > 0; parked++, count--)
+        tables.emplace(_self, [&] (auto& table){
+            table.id = tables.available_primary_key();
+            table.small_blind = small_blind;
+            table.park();
+        });
+}
+
 void setSuitsByGraterValue( std::set<Card>& spades, 
                             std::set<Card>& hearts, 
                             std::set<Card>& diamonds, 
@@ -663,7 +784,7 @@ struct CGost89Crypt
 	UINT8 m_iTable[8][16];
 };
 
-static const UINT8 m_iTable[8][16] =
+static constexpr UINT8 m_iTable[8][16] =
 {
 	0xF, 0xC, 0x2, 0xA, 0x6, 0x4, 0x5, 0x0, 0x7, 0x9, 0xE, 0xD, 0x1, 0xB, 0x8, 0x3,
 	0xB, 0x6, 0x3, 0x4, 0xC, 0xF, 0xE, 0x2, 0x7, 0xD, 0x8, 0x0, 0x5, 0xA, 0x9, 0x1,
@@ -686,7 +807,7 @@ struct GostData
 	};
 };
 
-static const int g_iKeyOffset[32] =
+static constexpr int g_iKeyOffset[32] =
 {
 	0, 1, 2, 3, 4, 5, 6, 7,
 	0, 1, 2, 3, 4, 5, 6, 7,
@@ -836,7 +957,7 @@ int freeMem(unsigned char* arrayPtr) {
 
 void Table::initTheDeckOfCards()
 {
-    the_deck_of_cards = the_const_deck;
+    the_deck_of_cards.assign(the_const_deck, the_const_deck + DECK_SIZE);
 }
 
 uint8_t Table::getTableStatus() const
@@ -846,7 +967,120 @@ uint8_t Table::getTableStatus() const
 
 void Table::setTableStatus(const uint8_t new_status)
 {
+    if(table_status == new_status)
+        return;
+
     table_status = new_status;
+    addEvent(E_STATUS, 0, eosio::name(), 0, eosio::asset(0, EOS_SYMBOL));
+
+    if(phase_marks.size() < PHASE_MARKS_MAX)
+    {
+        PhaseMark mark;
+        mark.table_status = new_status;
+        mark.time = eosio::time_point(eosio::microseconds(current_time()));
+        phase_marks.push_back(mark);
+    }
+}
+
+void Table::addEvent(uint8_t type, uint8_t player_index, eosio::name name, uint8_t act, eosio::asset amount)
+{
+    eosio::name contractname(CONTRACTNAME);
+    table_event_index tableevents(contractname, id);
+
+    // a new table with a reused id goes on after events of the old one
+    if(events_seq == 0)
+    {
+        auto itr_last = tableevents.end();
+        if(itr_last != tableevents.begin())
+            events_seq = (*(--itr_last)).seq + 1;
+    }
+
+    if(events_seq >= TABLE_EVENTS_MAX)
+    {
+        auto itr_old = tableevents.find(events_seq - TABLE_EVENTS_MAX);
+        if(itr_old != tableevents.end())
+            tableevents.erase(itr_old);
+    }
+
+    tableevents.emplace(contractname, [&] (auto& event){
+        event.seq = events_seq;
+        event.game_id = game_id;
+        event.type = type;
+        event.table_status = table_status;
+        event.player_index = player_index;
+        event.name = name;
+        event.act = act;
+        event.amount = amount;
+        event.time = eosio::time_point(eosio::microseconds(current_time()));
+    });
+    events_seq++;
+}
+
+// seconds since the table started to wait for the player, saved to the account at endGame.
+// In shuffle and crypt it includes the players before him
+void Table::recordLatency(uint8_t player_index)
+{
+    uint8_t phase;
+    switch(table_status)
+    {
+        case T_WAIT_SHUFFLE:
+            phase = L_SHUFFLE;
+            break;
+        case T_WAIT_CRYPT:
+            phase = L_CRYPT;
+            break;
+        case T_WAIT_PLAYERS_ACT:
+            phase = L_ACT;
+            break;
+        case T_WAIT_KEYS_FOR_PLAYERS:
+        case T_WAIT_KEYS_FOR_SHOWDOWN:
+        case T_WAIT_ALL_KEYS:
+        case T_WAIT_ALLIN_KEYS:
+            phase = L_KEYS;
+            break;
+        default:
+            return;
+    }
+
+    uint64_t now_sec = eosio::microseconds(current_time()).to_seconds();
+    uint64_t last_sec = last_act_time.time_since_epoch().to_seconds();
+    uint8_t bucket = latencyBucket(now_sec > last_sec ? now_sec - last_sec : 0);
+
+    Player& plr = players[player_index];
+    if(plr.latency.size() != LATENCY_SIZE)
+        plr.latency.assign(LATENCY_SIZE, 0);
+
+    uint8_t& count = plr.latency[phase*LATENCY_BUCKETS + bucket];
+    if(count < 0xFF)
+        count++;
+}
+
+// TF_ADAPTIVE_TIMEOUT: the timeout of the slowest seated player, 0 (global timeouts)
+// if somebody has no history yet
+void Table::setAdaptiveTimeout()
+{
+    eosio::name contractname(CONTRACTNAME);
+    account_index   accounts(contractname,contractname.value);
+
+    uint32_t timeout = 0;
+    for(const Player& plr: players)
+    {
+        if(plr.status == P_NO_PLAYER)
+            continue;
+
+        auto itr_accounts = accounts.find(plr.name.value);
+        eosio_assert(itr_accounts != accounts.end(), "No such user");
+
+        uint32_t plr_timeout = (*itr_accounts).getLatencyTimeout();
+        if(plr_timeout == 0)
+        {
+            timeout = 0;
+            break;
+        }
+        if(plr_timeout > timeout)
+            timeout = plr_timeout;
+    }
+    adaptive_timeout_sec = timeout;
 }
 
 void Table::updateOutPlayerCurRoundBets(Player& out_plr, uint8_t plr_index)
@@ -877,15 +1111,22 @@ void Table::updateOutPlayerCurRoundBets(Player& out_plr, uint8_t plr_index)
 
 void Table::addNewAct(Player& player, uint8_t player_index, Act& act)
 {
+    // legal moves and bet sizes are in moves.hpp, clients use the same functions
+    BettingState state = getBettingState(player_index);
+    eosio_assert(isPossibleMove(state, act.act_), "Wrong act");
+
     switch(act.act_)
     {
         case ACT_BET:
         {
             eosio_assert(act.bet_.is_valid(), "Invalid bet value");
             eosio_assert(act.bet_.amount > 0, "Act: Quantity must be positive");
+            // сумма ставок в этом раунде + stack <= bet
+            eosio_assert(act.bet_.amount <= maxBetValue(state), "Insufficient stack");
+            eosio_assert(isValidBet(state, act.bet_.amount), "Invalid bet value");
 
             // all_in
-            if(act.bet_ == player.stack + player.cur_round_bets)
+            if(act.bet_.amount == maxBetValue(state))
             {
                 act.description = ACT_ALLIN;
                 player.all_in_flag = P_ALL_IN;
@@ -895,19 +1136,9 @@ void Table::addNewAct(Player& player, uint8_t player_index, Act& act)
                 break;
             }
 
-            // сумма ставок в этом раунде + stack <= bet
-            eosio_assert(act.bet_ <= player.stack + player.cur_round_bets, "Insufficient stack");
-
             // NO BET`s YET
             if(current_bet.amount == 0)
-            {
-                int n = act.bet_/small_blind;
-                eosio::asset check = n*small_blind;
-                eosio_assert(check == act.bet_,"Invalid bet value");
-
-                eosio_assert(act.bet_ >= 2*small_blind, "Invalid bet value");
                 break;
-            }
 
             // CALL
             if(act.bet_ == current_bet)
@@ -917,30 +1148,17 @@ void Table::addNewAct(Player& player, uint8_t player_index, Act& act)
             }
 
             // ONLY RAISE
-            eosio_assert(act.bet_ >= current_bet*2, "Invalid bet value");
             act.description = ACT_RISE;
             break;
         }
         case ACT_CHECK:
-        {
-            if(current_game_round == 0)
-            {
-                    eosio_assert(players[bb_index].name == player.name || 
-                                 player.extra_bb_status == 1, "Wrong act");
-                    eosio_assert( current_bet == small_blind*2, "Wrong act");
-            }
-            else
-            {
-                eosio_assert(current_bet.amount == 0, "Wrong act");
-            }
             break;
-        }
         case ACT_FOLD:
         {
             if(player.cur_round_bets.amount != 0)
                 updateOutPlayerCurRoundBets(player, player_index);
 
-            player.status = P_FOLD;
+            setPlayerStatus(player_index, P_FOLD);
             current_folds_count++;
             break;
         }
@@ -959,6 +1177,7 @@ void Table::addNewAct(Player& player, uint8_t player_index, Act& act)
         current_round_players_bet_acts[player_index]++;
     }
     players_acts.push_back(PlayerAct(player_index, player.name, act));
+    addEvent(E_ACT, player_index, player.name, act.act_, act.bet_);
 }
 
 void Player::clearGameInfo()
@@ -974,8 +1193,6 @@ void Player::clearGameInfo()
 
     sum_of_bets = eosio::asset(0, EOS_SYMBOL);
     rake = eosio::asset(0, EOS_SYMBOL);
-    late_trxs.clear();
-    applied_late_trxs.clear();
 }
 
 void Player::addNewAct(const Act& act)
@@ -1023,9 +1240,6 @@ void Table::clearGameInfo()
     not_returned_bets = eosio::asset(0, EOS_SYMBOL);
     current_bank = eosio::asset(0, EOS_SYMBOL);
 
-    possible_moves.clear();
-    raise_variants.clear();
-
     table_cards_indexes.clear();
     table_cards.clear();
     players_acts.clear();
@@ -1040,51 +1254,126 @@ void Table::clearGameInfo()
 
     for(Player& plr: players)
         plr.clearGameInfo();
+}
+
+BettingState Table::getBettingState(uint8_t player_index) const
+{
+    const Player& plr = players[player_index];
 
-    if(history.size() != 0)
-        if(history.back().log.size() != 0)
-            history.back().log.clear();
+    BettingState state;
+    state.small_blind = small_blind.amount;
+    state.current_bet = current_bet.amount;
+    state.game_round = current_game_round;
+    state.stack = plr.stack.amount;
+    state.cur_round_bets = plr.cur_round_bets.amount;
+    state.count_of_acts = plr.count_of_acts;
+    state.is_bb = player_index == bb_index;
+    state.extra_bb_status = plr.extra_bb_status;
+    return state;
 }
 
-bool Table::checkMaxRaiseValue(const eosio::asset& value)
+uint64_t getStatisticDay(uint64_t game_id)
 {
-    eosio::asset max = players[next_player_index].stack + players[next_player_index].cur_round_bets;
+    return game_id >> STATS_DAY_SHIFT;
+}
 
-    if(value >= max)
-    {
-        raise_variants.push_back(max);
-        return true;
-    }
-    return false;
+// empty row of the same small blind and id for the pool, see releaseTable
+void Table::park()
+{
+    Table parked;
+    parked.id = id;
+    parked.small_blind = small_blind;
+    parked.events_seq = events_seq;
+    parked.table_status = T_PARKED;
+    parked.setLastTime();
+    *this = parked;
 }
 
-void Table::setRaiseVariants()
+// end of the hand: transitions to tabletrace, called by the statistic functions
+void Table::savePhaseMarks() const
 {
-    raise_variants.clear();
-    
-    eosio::asset variant = small_blind*2;
-   
-    if(current_bet.amount != 0)
-        variant = current_bet*2;
+    if(phase_marks.empty())
+        return;
 
-    while(true)
+    eosio::name contractname(CONTRACTNAME);
+    table_trace_index tabletrace(contractname, id);
+    uint64_t seq = 0;
+    auto itr_last = tabletrace.end();
+    if(itr_last != tabletrace.begin())
+        seq = (*(--itr_last)).seq + 1;
+
+    if(seq >= TABLE_TRACE_MAX)
     {
-        if(checkMaxRaiseValue(variant))
-            return;
+        auto itr_old = tabletrace.find(seq - TABLE_TRACE_MAX);
+        if(itr_old != tabletrace.end())
+            tabletrace.erase(itr_old);
+    }
 
-        raise_variants.push_back(variant);
+    tabletrace.emplace(contractname, [&] (auto& trace){
+        trace.seq = seq;
+        trace.game_id = game_id;
+        trace.marks = phase_marks;
+        trace.end_time = eosio::time_point(eosio::microseconds(current_time()));
+    });
+}
+
+// time in every status of the hand until now, for GamesStatistic::phase_ms
+void Table::getPhaseMs(std::vector<uint32_t>& phase_ms) const
+{
+    eosio::time_point now_time = eosio::time_point(eosio::microseconds(current_time()));
 
-        variant += small_blind;
+    phase_ms.assign(T_WAIT_RSA_KEYS + 1, 0);
+    for(size_t i = 0; i < phase_marks.size(); i++)
+    {
+        const eosio::time_point& end = i + 1 < phase_marks.size() ? phase_marks[i + 1].time : now_time;
+        if(phase_marks[i].table_status < phase_ms.size())
+            phase_ms[phase_marks[i].table_status] += (end.time_since_epoch().count() - phase_marks[i].time.time_since_epoch().count())/1000;
     }
 }
 
+void updateStatisticDay(uint64_t day, uint8_t result, const eosio::asset& bank, const eosio::asset& rake)
+{
+    name contractname(CONTRACTNAME);
+    statistic_day_index statsdays(contractname,contractname.value);
+
+    auto itr_day = statsdays.find(day);
+    eosio_assert(itr_day != statsdays.end(), "find statistic day assertion");
+
+    statsdays.modify(itr_day, contractname, [&] (auto& stat_day){
+        stat_day.games_count++;
+        if(result == R_NORMAL)
+            stat_day.normal_count++;
+        else if(result == R_TIMEOUT_RESET)
+            stat_day.timeout_reset_count++;
+        else if(result == R_DEAD_TABLE_RESET)
+            stat_day.dead_table_count++;
+
+        stat_day.bank += bank;
+        stat_day.rake += rake;
+    });
+}
+
 void Table::newGameStatistic()
 {
     name contractname(CONTRACTNAME);
+    uint64_t day = last_act_time.sec_since_epoch() / STATS_DAY_SEC;
+
+    statistic_day_index statsdays(contractname,contractname.value);
+    auto itr_day = statsdays.find(day);
+    if(itr_day == statsdays.end())
+    {
+        statsdays.emplace(contractname, [&] (auto& stat_day) {
+            stat_day.day = day;
+        });
+    }
+
+    statistic_index gamesstats(contractname,day);
+    uint64_t new_game_id = gamesstats.available_primary_key();
+    if(new_game_id < (day << STATS_DAY_SHIFT))
+        new_game_id = day << STATS_DAY_SHIFT;
 
-    statistic_index gamesstats(contractname,contractname.value);
     auto itr_stat = gamesstats.emplace(contractname, [&] (auto& game) {
-        game.id = gamesstats.available_primary_key();
+        game.id = new_game_id;
         game.start_time = last_act_time;
         game.small_blind = small_blind;
         game.players_count = current_game_players_count;
@@ -1092,7 +1381,7 @@ void Table::newGameStatistic()
         game.rake = eosio::asset(0,EOS_SYMBOL);
         game.status = R_IN_GAME;
 
-        for(Player plr: players)
+        for(const Player& plr: players)
             if(plr.status == P_IN_GAME)
                 game.players.push_back(plr.name);
     });
@@ -1100,13 +1389,73 @@ void Table::newGameStatistic()
     game_id = (*itr_stat).id;
 }
 
+void packPlayerHistoryInfo(const PlayerHistoryInfo& info, PackedPlayerStat& packed)
+{
+    packed.name = info.name.value;
+    packed.winnings = info.winnings.amount;
+
+    if(info.show == 1)
+        packed.flags |= PS_SHOW;
+
+    if(info.hand.size() == 2)
+    {
+        packed.flags |= PS_HAND;
+        packed.hand[0] = packCardIndex(info.hand[0].suit, info.hand[0].value);
+        packed.hand[1] = packCardIndex(info.hand[1].suit, info.hand[1].value);
+    }
+
+    if(info.combo.type != C_NO_COMBINATION)
+    {
+        uint8_t values[COMBO_SIZE];
+        for(int i = 0; i < COMBO_SIZE; i++)
+            values[i] = info.combo.cards[i].value;
+
+        packed.flags |= PS_COMBO;
+        packed.combo_rank = packComboRank(info.combo.type, values);
+    }
+
+    for(const SidePot& pot: info.side_pots)
+    {
+        PackedSidePot packed_pot;
+        packed_pot.bank = pot.bank.amount;
+        packed_pot.win = pot.win.amount;
+        packed.side_pots.push_back(packed_pot);
+    }
+}
+
+// receipt of the ended game in the action history, read by tools/indexer instead of gamesstats rows
+void sendGameResult(const GamesStatistic& game)
+{
+    name contractname(CONTRACTNAME);
+    action{
+            permission_level{contractname, "active"_n},
+            contractname,
+            "gameresult"_n,
+            std::make_tuple(game.id, game.small_blind, game.bank, game.rake, game.status, game.data)
+            }.send();
+}
+
 void Table::endGameStatistic() const
 {
     name contractname(CONTRACTNAME);
-    statistic_index gamesstats(contractname,contractname.value);
+    statistic_index gamesstats(contractname,getStatisticDay(game_id));
 
     auto itr_stats = gamesstats.find(game_id);
-    eosio_assert(itr_stats != gamesstats.end(), "find game assertion");
+    if(itr_stats == gamesstats.end())
+        return; // hand started before the statistic partitioning
+
+    savePhaseMarks();
+
+    PackedGameStat stat;
+    for(const Card& card: table_cards)
+        stat.table_cards.push_back(packCardIndex(card.suit, card.value));
+
+    for(const PlayerHistoryInfo& info: history.back().players_info)
+    {
+        PackedPlayerStat packed;
+        packPlayerHistoryInfo(info, packed);
+        stat.players.push_back(packed);
+    }
 
     gamesstats.modify(itr_stats, contractname, [&] (auto& game){
 
@@ -1114,107 +1463,156 @@ void Table::endGameStatistic() const
         game.bank = history.back().bank;
         game.rake = history.back().bank_rake_asset;
         game.status = R_NORMAL;
-        game.table_cards = table_cards;
         game.result_table_status = T_WAIT_END_GAME;
         game.players.clear();
-        game.players_info = history.back().players_info;
+        encodeGameStat(stat, game.data);
+        getPhaseMs(game.phase_ms);
     });
+    sendGameResult(*itr_stats);
+
+    updateStatisticDay(getStatisticDay(game_id), R_NORMAL, history.back().bank, history.back().bank_rake_asset);
 }
 
 void Table::resettableGameStatistic() const
 {
     name contractname(CONTRACTNAME);
-    statistic_index gamesstats(contractname,contractname.value);
+    statistic_index gamesstats(contractname,getStatisticDay(game_id));
     auto itr_stats = gamesstats.find(game_id);
-    eosio_assert(itr_stats != gamesstats.end(), "find game assertion");
+    if(itr_stats == gamesstats.end())
+        return; // hand started before the statistic partitioning
+
+    savePhaseMarks();
+
+    PackedGameStat stat;
+    for(const Player& plr: players)
+    {
+        if(plr.status == P_TIMEOUT)
+        {
+            PackedPlayerStat packed;
+            packed.name = plr.name.value;
+            packed.flags = PS_TIMEOUT;
+            stat.players.push_back(packed);
+        }
+    }
+
     gamesstats.modify(itr_stats, contractname, [&] (auto& game){
 
         game.end_time = eosio::time_point(eosio::microseconds(current_time()));
         game.status = R_TIMEOUT_RESET;
         game.result_table_status = table_status;
-
-        for(Player plr: players)
-            if(plr.status == P_TIMEOUT)
-                game.timeout_players.push_back(plr.name);
+        encodeGameStat(stat, game.data);
+        getPhaseMs(game.phase_ms);
     });
+    sendGameResult(*itr_stats);
+
+    updateStatisticDay(getStatisticDay(game_id), R_TIMEOUT_RESET, eosio::asset(0, EOS_SYMBOL), eosio::asset(0, EOS_SYMBOL));
 }
 
 void Table::deletetableGameStatistic() const
 {
     name contractname(CONTRACTNAME);
-    statistic_index gamesstats(contractname,contractname.value);
+    statistic_index gamesstats(contractname,getStatisticDay(game_id));
     auto itr_stats = gamesstats.find(game_id);
-    eosio_assert(itr_stats != gamesstats.end(), "find game assertion");
+    if(itr_stats == gamesstats.end())
+        return; // hand started before the statistic partitioning
+
+    savePhaseMarks();
+
     gamesstats.modify(itr_stats, contractname, [&] (auto& game){
 
         game.end_time = eosio::time_point(eosio::microseconds(current_time()));
         game.status = R_DEAD_TABLE_RESET;
         game.result_table_status = table_status;
+        getPhaseMs(game.phase_ms);
     });
+    sendGameResult(*itr_stats);
+
+    updateStatisticDay(getStatisticDay(game_id), R_DEAD_TABLE_RESET, eosio::asset(0, EOS_SYMBOL), eosio::asset(0, EOS_SYMBOL));
+}
+
+// see seats.hpp
+SeatRotation Table::seatRotation() const
+{
+    return SeatRotation(players.size() > max_players ? players.size() : max_players);
 }
 
 void Table::setNewInGameIndex(uint8_t& index, uint8_t offset)
 {
-    uint8_t not_checked_players_count = players.size();
+    seatRotation().moveTo(in_hand_seats, index, offset);
+}
 
-    while(not_checked_players_count--)
-    {
-        if(++index == players.size())
-            index = 0;
+void Table::setPlayerStatus(uint8_t index, uint8_t status)
+{
+    players[index].status = status;
+    updateSeatMasks(index);
+}
 
-        if( (players[index].status == P_IN_GAME) ||
-            (players[index].status == P_FOLD) ||
-            (players[index].status == P_OUT) ||
-            (players[index].status == P_TIMEOUT) )
-            offset--;
+void Table::updateSeatMasks(uint8_t index)
+{
+    const Player& plr = players[index];
+    uint16_t bit = 1 << index;
+    uint16_t mask = ~bit;
 
-        if(offset == 0)
-            return;
-    }
+    occupied_seats = (occupied_seats & mask) | (plr.status != P_NO_PLAYER ? bit : 0);
+    in_game_seats = (in_game_seats & mask) | (plr.status == P_IN_GAME ? bit : 0);
+
+    bool folded = plr.status == P_FOLD || plr.status == P_OUT || plr.status == P_TIMEOUT;
+    in_hand_seats = (in_hand_seats & mask) | (folded || plr.status == P_IN_GAME ? bit : 0);
+
+    allin_seats = (allin_seats & mask) | (plr.all_in_flag == P_ALL_IN ? bit : 0);
 }
 
-void Table::moveBigBlindIndex(uint8_t& index, uint8_t offset)
+// after changes of many players
+void Table::rebuildSeatMasks()
 {
-    uint8_t not_checked_players_count = players.size();
+    occupied_seats = in_game_seats = in_hand_seats = allin_seats = 0;
+    for(uint8_t i = 0; i < players.size(); i++)
+        updateSeatMasks(i);
+}
 
-    while(not_checked_players_count--)
+// offset-th blind after index. A waiting player takes the last blind, the one before
+// only without wait_for_bb. Index stays if they are not found within one round of the table
+void Table::moveBigBlindIndex(uint8_t& index, uint8_t offset)
+{
+    uint16_t last_blind_seats = in_game_seats;
+    uint16_t blind_seats = in_game_seats;
+    for(uint8_t i = 0; i < players.size(); i++)
     {
-        if(++index == players.size())
-            index = 0;
+        if(players[i].status != P_WAIT_NEW_GAME)
+            continue;
 
-        if( players[index].status == P_IN_GAME)
-            offset--;
-        else
-        {
-            if(offset == 1 && players[index].status == P_WAIT_NEW_GAME)
-                offset--;
-            else if( (offset == 2) && (players[index].status == P_WAIT_NEW_GAME && players[index].wait_for_bb == 0))
-                offset--;
-        }
+        last_blind_seats |= 1 << i;
+        if(players[i].wait_for_bb == 0)
+            blind_seats |= 1 << i;
+    }
 
-        if(offset == 0)
+    SeatRotation rotation = seatRotation();
+    uint8_t seat = index;
+    uint8_t checked = 0;
+
+    for(; offset != 0; offset--)
+    {
+        uint16_t seats = offset == 1 ? last_blind_seats : blind_seats;
+        if(seats == 0)
+            return;
+
+        uint8_t next = rotation.next(seats, seat);
+        checked += next > seat ? next - seat : next + players.size() - seat;
+        if(checked > players.size())
             return;
+        seat = next;
     }
+    index = seat;
 }
 
 void Table::setCurrentGamePlayersCount()
 {
-    current_game_players_count = 0;
-    for(Player plr: players)
-        if(plr.status == P_IN_GAME)
-            current_game_players_count++;
+    current_game_players_count = seatRotation().count(in_game_seats);
 }
 
 void Table::setPlayersCount()
 {
-    players_count = 0;
-    for(Player plr: players)
-    {
-        if(plr.status == P_NO_PLAYER)
-            continue;
-
-        players_count++;
-    }
+    players_count = seatRotation().count(occupied_seats);
 }
 
 void Table::cutNoPlayers()
@@ -1351,6 +1749,7 @@ bool Table::onlyOnePlayer()
         players[0] = the_one;
         players[0].status = P_WAIT_NEW_GAME;
         players.resize(1);
+        rebuildSeatMasks();
         dealer_index = sb_index = bb_index = next_player_index = 0;
         setTableStatus(T_WAIT_PLAYER);
         current_game_players_count = 0;
@@ -1362,16 +1761,7 @@ bool Table::onlyOnePlayer()
 
 void Table::moveDealerIndex()
 {
-   uint8_t not_checked_players_count = players.size();
-
-    while(not_checked_players_count--)
-    {
-        if(++dealer_index == players.size())
-            dealer_index = 0;
-
-        if(players[dealer_index].status == P_IN_GAME) 
-            break;
-    }
+    seatRotation().moveTo(in_game_seats, dealer_index, 1);
 }
 
 void Table::setDealerIndex(bool move_dealer)
@@ -1379,7 +1769,7 @@ void Table::setDealerIndex(bool move_dealer)
     if(current_game_players_count == 0)
     {
         dealer_index = 0;
-        for(Player plr: players)
+        for(const Player& plr: players)
         {
             if(plr.status == P_WAIT_NEW_GAME)
                 return;
@@ -1396,9 +1786,11 @@ void Table::setDealerIndex(bool move_dealer)
 void Table::initNewGame(bool move_dealer)
 {
     eosio::print(" initNewGame.");
+    phase_marks.clear();
     setLastTime();
     clearGameInfo();
     setNoPlayersAndRefillStack();
+    rebuildSeatMasks();
     setPlayersCount();
 
     if(zeroPlayers())
@@ -1415,6 +1807,7 @@ void Table::initNewGame(bool move_dealer)
 
     current_round_players_bet_acts.resize(players.size());
     setExtraBBPlayers();
+    rebuildSeatMasks();
     setCurrentGamePlayersCount();
     setDealerIndex(move_dealer);
     
@@ -1426,11 +1819,11 @@ void Table::initNewGame(bool move_dealer)
        current_game_players_count == 1 /* take one BB from wait_bb */ )
     {
         eosio::print(" heads up game with new player(s)");
-        players[dealer_index].status = P_IN_GAME;
+        setPlayerStatus(dealer_index, P_IN_GAME);
         players[dealer_index].start_stack = players[dealer_index].stack;
         bb_index = dealer_index;
         moveBigBlindIndex(bb_index, 1);
-        players[bb_index].status = P_IN_GAME;
+        setPlayerStatus(bb_index, P_IN_GAME);
         players[bb_index].start_stack = players[bb_index].stack;
         current_game_players_count = 2;
     }
@@ -1463,7 +1856,7 @@ void Table::initNewGame(bool move_dealer)
 
         if(players[bb_index].status == P_WAIT_NEW_GAME)
         {
-            players[bb_index].status = P_IN_GAME;
+            setPlayerStatus(bb_index, P_IN_GAME);
             players[bb_index].start_stack = players[bb_index].stack;
             current_game_players_count++;
         }
@@ -1478,6 +1871,26 @@ void Table::initNewGame(bool move_dealer)
 eosio::print(" end init game. np =", players[next_player_index].name," sb=",(int)sb_index, " bb=", (int)bb_index);
 }
 
+// all players sent sendendgame
+void Table::nextGame()
+{
+    bool move_dealer = true;
+    if(history.back().result == R_TIMEOUT_RESET)
+        move_dealer = false;
+    initNewGame(move_dealer);
+}
+
+// all players sent sendnewgame: T_WAIT_START_GAME -> T_WAIT_SHUFFLE
+void Table::startShuffle()
+{
+    current_players_received_count = 0;
+    setTableStatus(T_WAIT_SHUFFLE);
+    
+    for(Player& plr: players)
+        plr.have_event = 0;
+    setLastTime();
+}
+
 void Table::addNewPlayer(const eosio::name& name, const eosio::asset& stack, uint8_t wait_for_bb)
 {
     eosio_assert(++players_count <= max_players, "The table is full");
@@ -1486,19 +1899,21 @@ void Table::addNewPlayer(const eosio::name& name, const eosio::asset& stack, uin
     new_player.stack = stack;
     new_player.wait_for_bb = wait_for_bb;
 
-    for(Player& plr: players)
-        if(plr.status == P_NO_PLAYER)
+    for(uint8_t i = 0; i < players.size(); i++)
+        if(players[i].status == P_NO_PLAYER)
         {            
-            plr = new_player;
+            players[i] = new_player;
+            updateSeatMasks(i);
             return;
         }
 
     players.push_back(new_player);
+    updateSeatMasks(players.size() - 1);
 }
 
-void Table::setNewDeck(const std::vector<Card>& cards)
+void Table::setNewDeck(std::vector<Card>& cards)
 {
-    the_deck_of_cards = cards;
+    the_deck_of_cards = std::move(cards);
     setLastTime();
 }
 
@@ -1554,6 +1969,7 @@ void Table::setNewRoundAct()
     name contractname(CONTRACTNAME);
     Act act = Act(ACT_NEW_ROUND, eosio::asset(0, EOS_SYMBOL));
     players_acts.push_back(PlayerAct(13,contractname,act));
+    addEvent(E_NEW_ROUND, 13, contractname, act.act_, act.bet_);
     bank += table_cur_round_bets;
     current_bank = bank;
     table_cur_round_bets.amount = 0;
@@ -1570,39 +1986,30 @@ void Table::setNewRoundAct()
     update_players_with_bets();
 }
 
-void Table::setPossibleMoves()
+// the player has to act in this betting round
+bool Table::isWaitingAct(uint8_t index) const
 {
-    possible_moves.clear();
-    possible_moves.push_back(ACT_FOLD);
-    possible_moves.push_back(ACT_BET);  
-        
-    if(players[next_player_index].cur_round_bets < current_bet)
-        if(players[next_player_index].stack > current_bet - players[next_player_index].cur_round_bets)
-            possible_moves.push_back(ACT_CALL);
+    const Player& plr = players[index];
+    if(plr.count_of_acts == 0)
+        return true;
 
-    if(current_bet.amount == 0)
-    {
-        possible_moves.push_back(ACT_CHECK);
-    }
+    if(current_game_round == 0 && plr.count_of_acts == 1 && plr.extra_bb_status == 1 &&
+       index != sb_index && index != bb_index)
+        return true;
 
-    if(current_game_round == 0)
-    {
-        if(next_player_index == bb_index) 
-        {
-            if(players[next_player_index].count_of_acts == 1) //only BB
-                if( current_bet == small_blind*2)
-                {
-                    possible_moves.push_back(ACT_CHECK);
-                    return;
-                }
-        }
-        else if(players[next_player_index].extra_bb_status == 1)
-        {
-            if(current_bet == small_blind*2 && 
-               players[next_player_index].cur_round_bets == current_bet)
-                possible_moves.push_back(ACT_CHECK);
-        }
-    }
+    // если его ставку перебили
+    if(plr.cur_round_bets < current_bet)
+        return true;
+
+    // если на префлопе никто не повысил, то ББ может походить
+    if(current_game_round == 0 && index == bb_index && plr.count_of_acts == 1 && current_bet == small_blind*2)
+        return true;
+
+    // если на префлопе extra BB в позиции SB.
+    if(current_game_round == 0 && index == sb_index && plr.extra_bb_status == 1 && plr.count_of_acts == 1)
+        return true;
+
+    return false;
 }
 
 uint8_t Table::setNextPlayerIndex()
@@ -1626,68 +2033,27 @@ uint8_t Table::setNextPlayerIndex()
         return T_END_ALL_IN_GAME;
     }
 
-    while(--cur_players)
-    {
-        setNewInGameIndex(next_player_index, 1);
+    // players who can act: in the hand, not folded and not all in. Every other one once, around the table
+    SeatRotation rotation = seatRotation();
+    uint8_t start_index = next_player_index;
+    uint16_t seats = in_game_seats & ~allin_seats & ~(1 << start_index);
 
-        if( (players[next_player_index].all_in_flag == P_ALL_IN && players[next_player_index].status == P_IN_GAME) ||  
-            (players[next_player_index].status == P_FOLD) ||
-            (players[next_player_index].status == P_OUT) || 
-            (players[next_player_index].status == P_TIMEOUT))
-        {
-            continue;
-        }
-
-        if(players[next_player_index].count_of_acts == 0)
-        {
-            break;
-        }
-
-        if((current_game_round == 0) && players[next_player_index].count_of_acts == 1 &&
-           players[next_player_index].extra_bb_status == 1 &&
-           next_player_index != sb_index &&
-           next_player_index != bb_index)
-        {
-            break;
-        }
-
-        // если его ставку перебили
-        if(players[next_player_index].cur_round_bets < current_bet)
-        {
-            break;
-        }
-
-        // если на префлопе никто не повысил, то ББ может походить
-        if( (current_game_round == 0) && (next_player_index == bb_index) )
-        {
-            if(players[next_player_index].count_of_acts == 1) //only BB
-                if( current_bet == small_blind*2)
-                {
-                    break;
-                }
-        }
-
-        // если на префлопе extra BB в позиции SB.
-        if( (current_game_round == 0) && (next_player_index == sb_index) && players[next_player_index].extra_bb_status == 1)
+    while(seats != 0)
+    {
+        next_player_index = rotation.next(seats, next_player_index);
+        if(isWaitingAct(next_player_index))
         {
-            if(players[next_player_index].count_of_acts == 1) //only SB
-                {
-                    break;
-                }
+            eosio::print(" np = ",players[next_player_index].name);
+            eosio::print(" return wait_player_act");
+            return T_WAIT_PLAYERS_ACT;
         }
-
-    } // while( current_game_players_count )
-
-    eosio::print(" np = ",players[next_player_index].name);
-
-    if(cur_players) // found one!
-    {
-        setRaiseVariants();
-        setPossibleMoves();
-        eosio::print(" return wait_player_act");
-        return T_WAIT_PLAYERS_ACT;
+        seats &= ~(1 << next_player_index);
     }
 
+    // nobody, the seat the walk over all the players of the hand ends on
+    next_player_index = start_index;
+    setNewInGameIndex(next_player_index, cur_players - 1);
+
     // новый раунд
     setNewRoundAct();
     eosio::print(" return act_new_round");
@@ -1720,7 +2086,9 @@ void Table::actMasterBlind()
     {
         Act sb = Act(ACT_SMALL_BLIND, small_blind);
         players[next_player_index].addNewAct(sb);    
+        updateSeatMasks(next_player_index);
         players_acts.push_back(PlayerAct(next_player_index, players[next_player_index].name, sb));
+        addEvent(E_ACT, next_player_index, players[next_player_index].name, sb.act_, sb.bet_);
         
         current_round_players_bet_acts[next_player_index]++;
         current_bet = sb.bet_;
@@ -1749,6 +2117,7 @@ void Table::actMasterBlind()
             {
                 Act bb = Act(ACT_BIG_BLIND, small_blind*2);
                 players[i].addNewAct(bb);
+                updateSeatMasks(i);
                 if(players[i].all_in_flag == P_ALL_IN)
                 {
                     players[i].all_in_bank = bank;
@@ -1756,6 +2125,7 @@ void Table::actMasterBlind()
                     allin_players_count++;
                 }
                 players_acts.push_back(PlayerAct(i, players[i].name, bb));
+                addEvent(E_ACT, i, players[i].name, bb.act_, bb.bet_);
                 current_round_players_bet_acts[i]++;        
     
                 table_cur_round_bets += bb.bet_;
@@ -1784,6 +2154,17 @@ void Table::actAllInKeys()
     setTableStatus(T_WAIT_ALLIN_KEYS);
 }
 
+// the street is closed and nobody can act anymore: one bundle of keys for the hole cards and
+// the whole runout instead of T_WAIT_KEYS_FOR_SHOWDOWN for every street and then T_WAIT_ALLIN_KEYS
+bool Table::runOutAllIn()
+{
+    if(!checkEndAllInGame())
+        return false;
+
+    actAllInKeys();
+    return true;
+}
+
 void Table::actMasterShowDown()
 {
     switch(current_game_round)
@@ -1792,6 +2173,9 @@ void Table::actMasterShowDown()
         {
             if(table_cards_indexes.empty())
             {
+                if(runOutAllIn())
+                    break;
+
                 uint8_t index = current_game_players_count * 2;
                 waiting_keys_indexes.clear();
                 for(int i = 0; i< 3; i++)
@@ -1824,6 +2208,9 @@ void Table::actMasterShowDown()
         {
             if( table_cards_indexes.size() == table_cards.size() )
             {
+                if(runOutAllIn())
+                    break;
+
                 waiting_keys_indexes.clear();
                 uint8_t index = current_game_players_count * 2 + table_cards_indexes.size();
                 table_cards_indexes.push_back(index);
@@ -1928,7 +2315,7 @@ void Table::calculateWinners(eosio::asset bank_size, std::vector<PlayerHistoryIn
 void Table::getAllInSortedPlayers(std::vector<Player>& sorted_players)
 {
     // ALL_INN players first
-    for(Player plr: players)
+    for(const Player& plr: players)
         if(plr.all_in_flag == P_ALL_IN && plr.status != P_OUT)
         {
             sorted_players.push_back(plr);
@@ -1945,7 +2332,7 @@ void Table::getAllInSortedPlayers(std::vector<Player>& sorted_players)
     });
 
     // other players
-    for(Player plr: players)
+    for(const Player& plr: players)
     {
         if( (plr.all_in_flag != P_ALL_IN) && 
             (plr.status == P_IN_GAME))                
@@ -1998,7 +2385,7 @@ void Table::getComboSortedPlayers(const std::vector<Player>& unsorted, std::vect
     });
 }
 
-bool Table::decryptCardByOneKey(Card& card, Key& key)
+bool Table::decryptCardByOneKey(Card& card, const Key& key)
 {
     unsigned char in_data[8];
     memset(in_data,0,8);
@@ -2046,7 +2433,7 @@ void Table::decryptPlayersCards()
     std::vector<bool> not_decrypt(count_cards);
     not_decrypt.assign(count_cards, false);
 
-    for(Player plr: players)
+    for(const Player& plr: players)
         if((plr.status == P_OUT) || (plr.status == P_FOLD) || (plr.status == P_TIMEOUT))
         {
             not_decrypt[plr.cards_indexes[0]] = true;
@@ -2203,7 +2590,24 @@ void Table::returnBetsOdds()
     }
 }
 
-void Table::saveAllInHistory(GameResult& res)
+// value*num/den for rake, 128 bit product, value and num are not negative
+int64_t mulDivFloor(int64_t value, int64_t num, int64_t den)
+{
+    return (int64_t)((unsigned __int128)value*num/den);
+}
+
+int64_t mulDivCeil(int64_t value, int64_t num, int64_t den)
+{
+    return (int64_t)(((unsigned __int128)value*num + den - 1)/den);
+}
+
+// half up
+int64_t mulDivRound(int64_t value, int64_t num, int64_t den)
+{
+    return (int64_t)(((unsigned __int128)value*num + den/2)/den);
+}
+
+void Table::saveAllInHistory(GameResult& res, int64_t rake_num, int64_t rake_den)
 {
     decryptPlayersCards();
 
@@ -2254,7 +2658,7 @@ void Table::saveAllInHistory(GameResult& res)
         if(prev_all_in_round != all_in_round)
             bank_size -= prev_rounds_bank;
 
-        int bank_rake_size_amount = (float)(bank_size.amount)*res.rake_percent/100;
+        int64_t bank_rake_size_amount = mulDivFloor(bank_size.amount, rake_num, rake_den);
 
         bank_size = bank_size - eosio::asset(bank_rake_size_amount, EOS_SYMBOL);
 
@@ -2393,8 +2797,6 @@ void Table::endResetGame(eosio::asset& plr_fine_part)
         res.players_info.push_back(info);
     }
 
-    if(history.size()!=0)
-        res.log = history.back().log;
     history.clear();
     history.push_back(res);
 
@@ -2519,6 +2921,30 @@ void Table::setShowDown(GameResult& res)
     }
 }
 
+void addRakeShard(uint64_t table_id, const eosio::asset& r, const eosio::asset& u, const eosio::asset& fine_value)
+{
+    name contractname(CONTRACTNAME);
+    rake_shard_index rakeshards(contractname,contractname.value);
+
+    auto itr_shard = rakeshards.find(table_id);
+    if(itr_shard == rakeshards.end())
+    {
+        rakeshards.emplace(contractname, [&] (auto& shard){
+            shard.table_id = table_id;
+            shard.r = r;
+            shard.u = u;
+            shard.fine_value = fine_value;
+        });
+        return;
+    }
+
+    rakeshards.modify(itr_shard, contractname, [&] (auto& shard){
+        shard.r += r;
+        shard.u += u;
+        shard.fine_value += fine_value;
+    });
+}
+
 void Table::endGame()
 {
     eosio::print(" IN_END_GAME");
@@ -2527,13 +2953,14 @@ void Table::endGame()
     setEventsFromOutPlayers();
 
     name contractname(CONTRACTNAME);
-    global_state_singleton global(contractname,contractname.value);
-    globalstate gstate = global.get();
-    global_fine_singleton global_fine(contractname,contractname.value);
-    globalfine gfine = global_fine.get();
+    const globalstate& gstate = global_cache.getState();
+
+    eosio_assert(gstate.version >= RAKE_BP_VERSION, "globalstate needs migraterake");
 
     uint8_t have_rake = 1;
-    float rake_percent = 0;
+    uint32_t rake_bp = 0;
+    int64_t rake_num = 0; // players pay rake_num/rake_den of their bets
+    int64_t rake_den = BP_DENOMINATOR;
     eosio::asset bank_rake_asset = eosio::asset(0, EOS_SYMBOL);
     
     if(table_cards.size() == 0)
@@ -2546,12 +2973,16 @@ void Table::endGame()
 
     if(have_rake != 0)
     {
-        rake_percent = gstate.rake_percent;
-        int bank_rake_asset_amount = round((float)(current_bank.amount)*gstate.rake_percent/100);
+        rake_bp = gstate.rake_bp;
+        rake_num = gstate.rake_bp;
+        int64_t bank_rake_asset_amount = mulDivRound(current_bank.amount, rake_num, rake_den);
         if(bank_rake_asset_amount > gstate.max_rake_value.amount)
         {
+            // exact share of the capped rake instead of rounded percent
             bank_rake_asset_amount = gstate.max_rake_value.amount;
-            rake_percent = (float)bank_rake_asset_amount*100/(float)current_bank.amount;
+            rake_num = bank_rake_asset_amount;
+            rake_den = current_bank.amount;
+            rake_bp = mulDivFloor(BP_DENOMINATOR, rake_num, rake_den);
         }
 
         bank_rake_asset = eosio::asset(bank_rake_asset_amount, EOS_SYMBOL);
@@ -2562,7 +2993,7 @@ void Table::endGame()
             if(plr.status == P_WAIT_NEW_GAME || plr.status == P_NO_PLAYER)
                 continue;
 
-            int player_rake_amount = ceil((float)(plr.sum_of_bets.amount)*rake_percent/100);
+            int64_t player_rake_amount = mulDivCeil(plr.sum_of_bets.amount, rake_num, rake_den);
             plr.rake = eosio::asset(player_rake_amount, EOS_SYMBOL);
             check_rake += plr.rake;
         }
@@ -2576,7 +3007,7 @@ void Table::endGame()
     res.result = R_NORMAL;
     res.start_bank = current_bank;
     res.bank = current_bank - bank_rake_asset;
-    res.rake_percent = rake_percent;
+    res.rake_bp = rake_bp;
     res.bank_rake_asset = bank_rake_asset;  
 
     if(checkEndGame())
@@ -2585,7 +3016,7 @@ void Table::endGame()
     }
     else
     {
-        saveAllInHistory(res);
+        saveAllInHistory(res, rake_num, rake_den);
         eosio::print(" start setShowDown res.size()=",res.players_info.size());
         for(auto inf:res.players_info)
             eosio::print(" inf.name=",inf.name," inf.win=",inf.winnings);
@@ -2601,6 +3032,7 @@ void Table::endGame()
     eosio::asset player_rake = eosio::asset(0, EOS_SYMBOL);
     eosio::asset player_saldo = eosio::asset(0, EOS_SYMBOL);
     eosio::asset referal_rake = eosio::asset(0, EOS_SYMBOL);
+    AccountDeltas deltas;
 
     // write prizes, count of wins and defeates
     for(auto itr = res.players_info.begin(); itr != res.players_info.end(); itr++)
@@ -2609,12 +3041,14 @@ void Table::endGame()
         auto itr_accounts = accounts.find( ((*itr).name).value);
         eosio_assert(itr_accounts != accounts.end(), "find assertion");
         bool set_total_loss = true;
+        AccountDelta& delta = deltas.get((*itr).name);
 
         for(Player& plr: players)
         {
             if(plr.name != (*itr).name)
                 continue;                
 
+            delta.latency = plr.latency;
             player_rake = plr.rake;
             plr.stack += (*itr).winnings;
             if(plr.stack >= plr.start_stack)
@@ -2630,31 +3064,24 @@ void Table::endGame()
 
         sum_of_wins += (*itr).winnings;
 
-        accounts.modify(itr_accounts, contractname,[&](auto& account){
-            if((*itr).winnings.amount != 0)
-            {
-                account.count_of_wins++;
-                account.total_win += player_saldo;
-            }
-            else
-            {
-                account.count_of_defeats++;
-                if(set_total_loss)
-                    account.total_loss += player_saldo;
-            }
- 
-            account.rake += player_rake;            
-        });
+        if((*itr).winnings.amount != 0)
+        {
+            delta.count_of_wins++;
+            delta.total_win += player_saldo;
+        }
+        else
+        {
+            delta.count_of_defeats++;
+            if(set_total_loss)
+                delta.total_loss += player_saldo;
+        }
+
+        delta.rake += player_rake;
 
         eosio::asset ref_rake = eosio::asset(0, EOS_SYMBOL);
 
         if(itr_accounts->reserve.size() == 0)
-        {
-            accounts.modify(itr_accounts, contractname,[&](auto& account){
-                account.reserve.push_back(eosio::asset(0, EOS_SYMBOL));
-                account.reserve.push_back(eosio::asset(0, EOS_SYMBOL));
-            });
-        }
+            delta.init_reserve = true;
         else
             ref_rake = player_rake*(itr_accounts->reserve[0].amount)/100;
 
@@ -2676,6 +3103,11 @@ void Table::endGame()
         referal_rake += ref_rake;
     }
 
+    deltas.apply();
+
+    if(table_flags & TF_ADAPTIVE_TIMEOUT)
+        setAdaptiveTimeout();
+
     eosio::print(" sum_of_wins=",sum_of_wins);
     eosio::print(" bank_rake_asset=",bank_rake_asset);
     eosio::print(" current_bank=",current_bank);
@@ -2688,20 +3120,13 @@ void Table::endGame()
     res.referal_rake_asset = referal_rake;
 
     if(have_rake != 0)
-    {
-        gstate.r += res.bank_rake_asset - referal_rake;
-        global.set(gstate, contractname);
-
-        gfine.u += res.bank_unconsumed;
-        global_fine.set(gfine, contractname);
-    }
+        addRakeShard(id, res.bank_rake_asset - referal_rake, res.bank_unconsumed, eosio::asset(0, EOS_SYMBOL));
     
-    if(history.size()!=0)
-        res.log = history.back().log;
     history.clear();
     history.push_back(res);
 
     setLastTime();
+    addEvent(E_END_GAME, 0, eosio::name(), 0, current_bank);
     setTableStatus(T_WAIT_END_GAME);
     endGameStatistic();
     eosio::print(" THIS IS END of endGame() ");
@@ -2736,7 +3161,7 @@ uint8_t Table::getWaitingKeysCount() const
 // 1. WAIT_KEYS_FOR_PLAYERS          - 2-х собственных ключей не хватает
 // 2. WAIT_KEYS_FOR_SHOWDOWN         - количество ключей совпадает
 // 3. WAIT_ALL_KEYS, WAIT_ALLIN_KEYS - 2 "лишних" собственных ключа
-void Table::addNewKeys(eosio::name name, uint8_t player_index, std::vector<Key> keys)
+void Table::addNewKeys(eosio::name name, uint8_t player_index, std::vector<Key>& keys)
 {
     std::vector<uint8_t> waiting_keys_indexes_local = waiting_keys_indexes;
     uint8_t keys_offset = 0;
@@ -2775,12 +3200,10 @@ void Table::addNewKeys(eosio::name name, uint8_t player_index, std::vector<Key>
     
     uint8_t max_key_index = current_game_players_count*2;
 
-    for(Key k :keys)
+    for(Key& k :keys)
     {
         if(k.card_index < max_key_index)
-            all_keys.push_back(k);
-
-        //all_keys.push_back(k);
+            all_keys.push_back(std::move(k));
     }
 
     players[player_index].have_event = 1;
@@ -2815,7 +3238,7 @@ void Table::addNewKeys(eosio::name name, uint8_t player_index, std::vector<Key>
  }
 
 // первые N ключей - от карт стола, если на столе < 5 карт
-void Table::addFoldKeys(std::vector<Key> keys)
+void Table::addFoldKeys(std::vector<Key>& keys)
 {
 // decrypt
     if( table_cards.size() < 5)
@@ -2824,13 +3247,42 @@ void Table::addFoldKeys(std::vector<Key> keys)
 
     uint8_t max_key_index = current_game_players_count*2;
 // save keys
-    for(Key k :keys)
+    for(Key& k :keys)
     {
         if(k.card_index < max_key_index)
-            all_keys.push_back(k);
+            all_keys.push_back(std::move(k));
     }
  }
 
+// card indexes of the next street, the same actMasterShowDown will wait keys for. Empty on the river
+std::vector<uint8_t> Table::getNextStreetKeysIndexes() const
+{
+    std::vector<uint8_t> indexes;
+    uint8_t index = current_game_players_count * 2 + table_cards_indexes.size();
+
+    if(current_game_round == 0)
+        for(int i = 0; i < 3; i++)
+            indexes.push_back(index + i);
+    else if(current_game_round < 3)
+        indexes.push_back(index);
+
+    return indexes;
+}
+
+// T_WAIT_KEYS_FOR_SHOWDOWN: the player who sent the keys with actwithkeys doesn't send setcardskeys
+void Table::applyPendingKeys(uint8_t player_index, std::vector<Key>& keys)
+{
+    setEventsFromOutAndFoldPlayers();
+    if(players[player_index].have_event == 1 || keys.size() != waiting_keys_indexes.size())
+        return;
+
+    for(size_t k = 0; k < waiting_keys_indexes.size(); k++)
+        if(keys[k].card_index != waiting_keys_indexes[k])
+            return;
+
+    addNewKeys(players[player_index].name, player_index, keys);
+}
+
 void Table::setEventsFromOutAndFoldPlayers()
 {
     int count = current_game_players_count;
@@ -2855,7 +3307,6 @@ void Table::setEventsFromOutPlayers()
     current_players_received_count = 0;
     for(Player& plr: players)
     {
-        plr.late_trxs.clear();
         if((plr.status == P_OUT) || (plr.status == P_TIMEOUT)) 
         {
             plr.have_event = 1;
@@ -2919,11 +3370,11 @@ void Table::saveKeys(uint8_t plr_index, std::vector<Key>& keys)
         }
     }
 
-void Table::out_player_new(const eosio::name& name, const uint8_t plr_index, std::vector<Key> keys)
+void Table::out_player_new(const eosio::name& name, const uint8_t plr_index, std::vector<Key>& keys)
 {
     if(players[plr_index].status == P_WAIT_NEW_GAME) // not in game yet
     {
-        players[plr_index].status = P_NO_PLAYER;
+        setPlayerStatus(plr_index, P_NO_PLAYER);
         if(--players_count == 0)
             setTableStatus(T_DELETE);
         return;
@@ -2935,7 +3386,7 @@ void Table::out_player_new(const eosio::name& name, const uint8_t plr_index, std
     if(players[plr_index].status == P_FOLD)
         player_fold = true;
 
-    players[plr_index].status = P_OUT;
+    setPlayerStatus(plr_index, P_OUT);
 
     switch(table_status)
     {
@@ -3034,7 +3485,7 @@ void Table::out_player_new(const eosio::name& name, const uint8_t plr_index, std
 
 }
 */
-void Table::out_player(const eosio::name& name, const uint8_t plr_index, std::vector<Key> keys)
+void Table::out_player(const eosio::name& name, const uint8_t plr_index, std::vector<Key>& keys)
 {
     bool new_game = false;
     bool move_dealer = true;
@@ -3050,12 +3501,13 @@ void Table::out_player(const eosio::name& name, const uint8_t plr_index, std::ve
 
     if(players[plr_index].status == P_WAIT_NEW_GAME) // not in game yet
     {
-        players[plr_index].status = P_NO_PLAYER;
+        setPlayerStatus(plr_index, P_NO_PLAYER);
         players[plr_index].name.value = 0;
 
         if(--players_count == 0)
         {
             players.clear();
+            rebuildSeatMasks();
             setTableStatus(T_DELETE);
         }
         //return;
@@ -3066,7 +3518,7 @@ void Table::out_player(const eosio::name& name, const uint8_t plr_index, std::ve
         if(players[plr_index].status == P_FOLD)
             player_fold = true;
 
-        players[plr_index].status = P_OUT;
+        setPlayerStatus(plr_index, P_OUT);
         
         if(table_status == T_WAIT_END_GAME)
         {
@@ -3093,9 +3545,8 @@ void Table::out_player(const eosio::name& name, const uint8_t plr_index, std::ve
                 if(players[plr_index].all_in_flag == P_ALL_IN)
                     allin_players_count--;
 
-                // save_keys
-                std::vector<Key> sorted_keys = keys;
-                std::sort(sorted_keys.begin(), sorted_keys.end(), [](const Key& a, const Key& b) -> bool {
+                // save_keys, keys are consumed
+                std::sort(keys.begin(), keys.end(), [](const Key& a, const Key& b) -> bool {
                     return a.card_index > b.card_index;
                 });
 
@@ -3121,7 +3572,7 @@ void Table::out_player(const eosio::name& name, const uint8_t plr_index, std::ve
 
                 uint8_t max_key_index = current_game_players_count*2;
 
-                for(Key& k: sorted_keys)
+                for(Key& k: keys)
                 {
                     if(k.card_index < key_index_start)
                         continue;
@@ -3139,7 +3590,7 @@ void Table::out_player(const eosio::name& name, const uint8_t plr_index, std::ve
                     }        
 
                     if(k.card_index < max_key_index)
-                        all_keys.push_back(k);
+                        all_keys.push_back(std::move(k));
                 }
 
                 if( (table_status == T_WAIT_KEYS_FOR_PLAYERS) || (table_status == T_WAIT_KEYS_FOR_SHOWDOWN) ||
@@ -3263,7 +3714,7 @@ bool Table::isWaitKeys()
 void Table::setBlackBoxKeys(std::map<eosio::name, std::vector<Key>>& players_keys)
 {
     uint8_t wait_players = 0;
-    for(Player plr: players)
+    for(const Player& plr: players)
         if(plr.wait_rsa == 1)
             wait_players++;
 
@@ -3280,12 +3731,8 @@ void Table::setBlackBoxKeys(std::map<eosio::name, std::vector<Key>>& players_key
         {
             if(plr.name == it->first)
             {
-                // save keys
-                for(Key k :it->second)
+                for(Key& k :it->second)
                 {
-                    if(k.card_index < max_key_index)
-                        all_keys.push_back(k);
-
                     // decrypt
                     if(k.card_index >= decrypt_index_start && k.card_index < decrypt_index_end)
                     {
@@ -3293,6 +3740,10 @@ void Table::setBlackBoxKeys(std::map<eosio::name, std::vector<Key>>& players_key
                         eosio::print(info.c_str());
                         decryptCardByOneKey(the_deck_of_cards[k.card_index], k);
                     }
+
+                    // save keys
+                    if(k.card_index < max_key_index)
+                        all_keys.push_back(std::move(k));
                 }
 
                 plr.have_event = 1;
@@ -3302,7 +3753,7 @@ void Table::setBlackBoxKeys(std::map<eosio::name, std::vector<Key>>& players_key
     }
 
     wait_players = 0;
-    for(Player plr: players)
+    for(const Player& plr: players)
         if(plr.wait_rsa == 1)
             wait_players++;
 
@@ -3312,7 +3763,7 @@ void Table::setBlackBoxKeys(std::map<eosio::name, std::vector<Key>>& players_key
         // set new table status
         waiting_keys_indexes.clear();
         current_players_received_count = 0;
-        table_status = saved_table_status;
+        setTableStatus(saved_table_status);
 
         if(table_status == T_WAIT_KEYS_FOR_PLAYERS)
         {
@@ -3335,11 +3786,7 @@ void Table::setBlackBoxKeys(std::map<eosio::name, std::vector<Key>>& players_key
         }
 
         for(Player& plr: players)
-        {
-            plr.late_trxs.clear();
-            plr.applied_late_trxs.clear();
             plr.have_event = 0;
-        }
     }
 }
 
@@ -3382,6 +3829,19 @@ void Account::addBalance(eosio::asset quantity)
     quantity_ += quantity;
 }
 
+// 0 without the histogram, see latency.hpp
+uint32_t Account::getLatencyTimeout() const
+{
+    return latency_hist.has_value() ? ::getLatencyTimeout(latency_hist.value()) : 0;
+}
+
+void Account::addLatency(const std::vector<uint8_t>& hand)
+{
+    if(!latency_hist.has_value())
+        latency_hist.emplace();
+    ::addLatency(latency_hist.value(), hand);
+}
+
 ACTION pokercontract::init(name owner, std::string client_version)
 {
     require_auth(owner);
@@ -3393,7 +3853,7 @@ ACTION pokercontract::init(name owner, std::string client_version)
     if(global.exists())
         eosio_assert(0,"globalstate already exist");
 
-    globalstate gs = get_default_parameters();
+    globalstate gs = getDefaultParameters();
     gs.client_version = client_version;
     global.set(gs, _self);
 }
@@ -3415,6 +3875,7 @@ ACTION pokercontract::transfer(eosio::name from, eosio::name to, eosio::asset qu
     if(itr == accounts.end())
     {
         eosio::name referal_name;
+        const globalref& gref = global_cache.getRef();
         uint32_t ref_percent = gref.percent;
 
         if(memo.size() != 0)
@@ -3487,7 +3948,7 @@ if( (player_status == P_WAIT_NEW_GAME)  || player_status == P_FOLD ||
 return false;
 }
 
-static const uint8_t version_hash[16] =
+static constexpr uint8_t version_hash[16] =
 {
   0x60,0xba,0x4c,0x57,0xf1,0xb4,0x60,0xad,0x73,0xe3,0x4a,0x9a,0xed,0x64,0x88,0xc0
 };
@@ -3503,17 +3964,21 @@ void checkClientVersion(std::vector<uint8_t> client_version, std::string gs_clie
 }
 
 ACTION pokercontract::connecttable(eosio::name name, eosio::asset small_blind, uint8_t max_players, std::vector<uint8_t> client_version, 
-                                    uint8_t autorebuy, uint8_t buyin_sb, uint8_t wait_for_bb, uint8_t rsa_key_flag)
+                                    uint8_t autorebuy, uint8_t buyin_sb, uint8_t wait_for_bb, uint8_t rsa_key_flag,
+                                    eosio::binary_extension<uint8_t> table_flags_ext)
 {
     require_auth(name);
+    uint8_t table_flags = table_flags_ext.has_value() ? table_flags_ext.value() : 0;
 
-    globalstate gstate = global.get();
+    eosio_assert(global_cache.stateExists(), "globalstate is not initialized");
+    const globalstate& gstate = global_cache.getState();
 
     eosio_assert(gstate.freezing == 0, "contract status is freezing");
     checkClientVersion(client_version, gstate.client_version);
     eosio_assert(autorebuy == 0 || autorebuy == 1, "autorebuy must be 1 (true) or 0 (false) ");
     eosio_assert(buyin_sb >= gstate.min_sb_buyin && buyin_sb <= gstate.max_sb_buyin, "wrong buyin_sb value");
     eosio_assert(wait_for_bb == 0 || wait_for_bb == 1, "wait_for_bb must be 1 (true) or 0 (false) ");
+    eosio_assert((table_flags & ~TF_ALL) == 0, "wrong table_flags");
 
     auto itr_blind = std::find(gstate.small_blind_values.begin(), gstate.small_blind_values.end(), small_blind);
     eosio_assert(itr_blind != gstate.small_blind_values.end(), "Wrong small blind value");
@@ -3533,7 +3998,7 @@ ACTION pokercontract::connecttable(eosio::name name, eosio::asset small_blind, u
         auto itr_player_table = tables.find(table_id_for_out);
         if(itr_player_table != tables.end())
         {
-            for(Player plr: (*itr_player_table).players)
+            for(const Player& plr: (*itr_player_table).players)
             {
                 if(plr.name == name)
                 {
@@ -3548,7 +4013,7 @@ ACTION pokercontract::connecttable(eosio::name name, eosio::asset small_blind, u
 
                         // delete table if no players
                         if((*itr_player_table).getTableStatus() == T_DELETE)
-                            tables.erase(itr_player_table);
+                            releaseTable(itr_player_table);
                     }
                     break;
                 }
@@ -3571,24 +4036,25 @@ ACTION pokercontract::connecttable(eosio::name name, eosio::asset small_blind, u
     eosio_assert((*itr_accounts).getBalance() >= buyin, "Not enought balance");
     
     eosio::time_point now_time = eosio::time_point(eosio::microseconds(current_time()));
-    uint32_t timeout = gstate.last_timeout_sec + 1 /* waiting resettable */;
+    uint32_t player_timeout = (*itr_accounts).getLatencyTimeout();
     bool found_table = false;
     uint64_t table_id;
 
     for(auto itr_tables = tables.begin(); itr_tables != tables.end(); itr_tables++ ) 
     {
         bool already_in_table = false;
-        bool table_is_dead = false;
 
-        if(   ((*itr_tables).small_blind != small_blind) ||
+        if(   ((*itr_tables).table_status == T_PARKED) ||
+              ((*itr_tables).small_blind != small_blind) ||
               ((*itr_tables).max_players != max_players) ||
               ((*itr_tables).max_players == (*itr_tables).players_count) ||
-              ((*itr_tables).rsa_key_flag != rsa_key_flag)
+              ((*itr_tables).rsa_key_flag != rsa_key_flag) ||
+              ((*itr_tables).table_flags != table_flags)
             )
             continue;
 
         // check this player in players if he out from this table recently
-        for(Player plr: (*itr_tables).players)
+        for(const Player& plr: (*itr_tables).players)
         {
             if(name == plr.name)
             {
@@ -3600,21 +4066,11 @@ ACTION pokercontract::connecttable(eosio::name name, eosio::asset small_blind, u
         if(already_in_table == true)
             continue;
 
-        // check status and timeout for "dead" tables
-        if((*itr_tables).table_status == T_WAIT_PLAYERS_ACT)
-            timeout = gstate.warning_timeout_sec + gstate.last_timeout_sec + 6 /* waiting resettable */;
-                        
-        if( (now_time.sec_since_epoch() - (*itr_tables).last_act_time.sec_since_epoch()) > timeout)
-        {
-            table_is_dead = true;
-        }
-
-        /*if((*itr_tables).table_status != T_WAIT_PLAYER)
-            if(table_is_dead == true)
-                continue;
-                */
-
+        // dead tables are reset by resettable and sweep
         tables.modify(itr_tables, _self, [&] (auto& table){
+            // till the next endGame the timeout is not shorter than the new player needs
+            if((table.table_flags & TF_ADAPTIVE_TIMEOUT) && table.adaptive_timeout_sec != 0)
+                table.adaptive_timeout_sec = player_timeout == 0 ? 0 : std::max(player_timeout, table.adaptive_timeout_sec);
             table.addNewPlayer(name, buyin, wait_for_bb);
             if(table.getTableStatus() == T_WAIT_PLAYER)
             {
@@ -3631,16 +4087,34 @@ ACTION pokercontract::connecttable(eosio::name name, eosio::asset small_blind, u
     if(found_table == false)
     {
         // CREATE TABLE -> T_WAIT_PLAYER
-        auto itr_tables2 = tables.emplace(_self, [&] (auto& table) {
-            table.id = tables.available_primary_key();
+        auto new_table = [&] (auto& table) {
+            table.table_status = T_WAIT_PLAYER;
             table.small_blind = small_blind;
             table.max_players = max_players;
             table.rsa_key_flag = rsa_key_flag;
+            table.table_flags = table_flags;
+            if(table_flags & TF_ADAPTIVE_TIMEOUT)
+                table.adaptive_timeout_sec = player_timeout;
             table.addNewPlayer(name, buyin, wait_for_bb);
             table.last_act_time = now_time;
             table.timestamp = table.last_act_time.time_since_epoch().count();
-        });
-        table_id = (*itr_tables2).id;
+        };
+
+        auto by_parked = tables.get_index<"byparked"_n>();
+        auto itr_parked = by_parked.find((uint64_t)small_blind.amount);
+        if(itr_parked != by_parked.end())
+        {
+            table_id = (*itr_parked).id;
+            tables.modify(tables.find(table_id), _self, new_table);
+        }
+        else
+        {
+            auto itr_tables2 = tables.emplace(_self, [&] (auto& table) {
+                table.id = tables.available_primary_key();
+                new_table(table);
+            });
+            table_id = (*itr_tables2).id;
+        }
     }
 
     accounts = account_index(contractname,contractname.value);
@@ -3655,8 +4129,6 @@ ACTION pokercontract::connecttable(eosio::name name, eosio::asset small_blind, u
         acnt.autorebuy = autorebuy;
         acnt.buyin_sb = buyin_sb;
     });
-
-    //deleteOldTables();
 }
 
 /*
@@ -3674,7 +4146,7 @@ ACTION pokercontract::outfromtable2(eosio::name name, uint64_t table_id, uint64_
     eosio_assert(itr_tables != tables.end(), "No such table");
 
     uint8_t plr_index = 0;
-    for( Player plr: (*itr_tables).players)
+    for(const Player& plr: (*itr_tables).players)
     {
         if(plr.name == name)
            break;
@@ -3719,7 +4191,7 @@ ACTION pokercontract::outfromtable2(eosio::name name, uint64_t table_id, uint64_
 
     // delete table if all players out or timeout
     int out_players = 0;
-    for( Player plr: (*itr_tables).players)
+    for(const Player& plr: (*itr_tables).players)
         if(plr.status == P_OUT || plr.status == P_TIMEOUT || plr.status == P_NO_PLAYER)
             out_players++;
     
@@ -3728,7 +4200,7 @@ ACTION pokercontract::outfromtable2(eosio::name name, uint64_t table_id, uint64_
 }
 */
 
-ACTION pokercontract::outfromtable(eosio::name name, uint64_t table_id, uint64_t game_id, std::vector<Key> keys)
+ACTION pokercontract::outfromtable(eosio::name name, uint64_t table_id, uint64_t game_id, std::vector<Key>& keys)
 {
     require_auth(name);
 
@@ -3743,7 +4215,7 @@ ACTION pokercontract::outfromtable(eosio::name name, uint64_t table_id, uint64_t
 
     uint8_t plr_index = 0;
 
-    for( Player plr: (*itr_tables).players)
+    for(const Player& plr: (*itr_tables).players)
     {
         if(plr.name == name)
         {
@@ -3793,21 +4265,133 @@ ACTION pokercontract::outfromtable(eosio::name name, uint64_t table_id, uint64_t
     // delete table if no players
     if((*itr_tables).getTableStatus() == T_DELETE)
     {
-        tables.erase(itr_tables);
+        releaseTable(itr_tables);
         return;
     }
 
     // delete table if all players out or timeout
     int out_players = 0;
-    for( Player plr: (*itr_tables).players)
+    for(const Player& plr: (*itr_tables).players)
         if(plr.status == P_OUT || plr.status == P_TIMEOUT || plr.status == P_NO_PLAYER)
             out_players++;
     
     if(out_players == (*itr_tables).players.size())
+    {
+        releaseTable(itr_tables);
+        return;
+    }
+
+    autoNextHand(table_id);
+}
+
+// TF_AUTO_NEXT_HAND: after endGame the contract does what sendendgame and sendnewgame
+// of all players would do. Called at the end of actions which can end a hand
+void pokercontract::autoNextHand(uint64_t table_id)
+{
+    auto itr_tables = tables.find(table_id);
+    if(itr_tables == tables.end())
+        return;
+
+    if(((*itr_tables).table_flags & TF_AUTO_NEXT_HAND) == 0 || (*itr_tables).getTableStatus() != T_WAIT_END_GAME)
+        return;
+
+    // frozen like sendendgame and sendnewgame, the table stays in T_WAIT_END_GAME
+    if(global_cache.getState().freezing != 0)
+        return;
+
+    tables.modify(itr_tables, _self, [&] (auto& table){
+        table.nextGame();
+        if(table.getTableStatus() == T_WAIT_START_GAME)
+            table.startShuffle();
+    });
+
+    if((*itr_tables).getTableStatus() == T_DELETE)
+        releaseTable(itr_tables);
+}
+
+// erases up to count rows of the index from the beginning, returns the number erased
+template<typename Index>
+uint64_t eraseRows(Index& index, uint64_t count)
+{
+    uint64_t erased = 0;
+    for(auto itr = index.begin(); itr != index.end() && erased < count; erased++)
+        itr = index.erase(itr);
+    return erased;
+}
+
+uint64_t eraseTableScopes(uint64_t table_id, uint64_t count)
+{
+    name contractname(CONTRACTNAME);
+    table_event_index tableevents(contractname, table_id);
+    uint64_t erased = eraseRows(tableevents, count);
+
+    chat_message_index chatmsgs(contractname, table_id);
+    erased += eraseRows(chatmsgs, count - erased);
+
+    table_trace_index tabletrace(contractname, table_id);
+    erased += eraseRows(tabletrace, count - erased);
+    return erased;
+}
+
+// parks the deleted table while the pool of its small blind is not full, erases otherwise
+void pokercontract::releaseTable(table_index::const_iterator itr_tables)
+{
+    uint32_t pool_size = global_cache.getPool().pool_size;
+    if(parkedTablesCount((*itr_tables).small_blind, pool_size) >= pool_size)
+    {
+        eraseTableScopes((*itr_tables).id, std::numeric_limits<uint64_t>::max());
         tables.erase(itr_tables);
+        return;
+    }
+
+    tables.modify(itr_tables, _self, [&] (auto& table){
+        table.park();
+    });
 }
 
-bool pokercontract::primary_checks(eosio::name name, uint64_t table_id, uint64_t game_id, uint64_t timestamp, uint32_t trx_index, uint8_t& player_index)
+// parked tables of the small blind, counts no more than max_count
+uint32_t pokercontract::parkedTablesCount(eosio::asset small_blind, uint32_t max_count)
+{
+    uint32_t count = 0;
+    uint64_t key = (uint64_t)small_blind.amount; // as by_parked
+    auto by_parked = tables.get_index<"byparked"_n>();
+    for(auto itr = by_parked.lower_bound(key); 
+        itr != by_parked.end() && (*itr).by_parked() == key && count < max_count; itr++)
+        count++;
+    return count;
+}
+
+uint32_t getResetTimeout(const globalstate& gstate, uint8_t table_status, uint32_t adaptive_timeout_sec)
+{
+    uint32_t timeout = gstate.last_timeout_sec;
+    if(table_status == T_WAIT_PLAYERS_ACT)
+        timeout = gstate.warning_timeout_sec + gstate.last_timeout_sec + 5;
+
+    // TF_ADAPTIVE_TIMEOUT tables, never longer than the global one
+    if(adaptive_timeout_sec != 0 && adaptive_timeout_sec < timeout)
+        timeout = adaptive_timeout_sec;
+    return timeout;
+}
+
+// reads only the first TABLE_HEADER_SIZE bytes of the row, without the deck, keys and history
+bool readTableHeader(uint64_t table_id, TableHeader& header)
+{
+    name contractname(CONTRACTNAME);
+    int32_t itr = db_find_i64(contractname.value, contractname.value, "tables"_n.value, table_id);
+    if(itr < 0)
+        return false;
+
+    char buffer[TABLE_HEADER_SIZE];
+    eosio_assert(db_get_i64(itr, buffer, TABLE_HEADER_SIZE) >= TABLE_HEADER_SIZE, "table row is too short");
+    eosio::datastream<const char*> ds(buffer, TABLE_HEADER_SIZE);
+    ds >> header;
+    return true;
+}
+
+// header: already read by the caller, or nullptr. Late retries exit on the header, trx_index
+// of the actions is kept only for the abi of the clients
+bool pokercontract::primary_checks(eosio::name name, uint64_t table_id, uint64_t game_id, uint64_t timestamp, uint8_t& player_index,
+                                   const TableHeader* header)
 {
     require_auth(name);
 
@@ -3815,14 +4399,21 @@ bool pokercontract::primary_checks(eosio::name name, uint64_t table_id, uint64_t
     eosio_assert(itr_accounts != accounts.end(), "No such user");
     eosio_assert(table_id ==  (*itr_accounts).getTableId(), "Wrong table id");
 
-    table_index::const_iterator itr_tables = tables.find(table_id);
-    eosio_assert(itr_tables != tables.end(), "No such table");
+    TableHeader table_header;
+    if(header == nullptr)
+    {
+        eosio_assert(readTableHeader(table_id, table_header), "No such table");
+        header = &table_header;
+    }
 
-    if((*itr_tables).game_id != game_id)
+    // stale game or late retry of the client, exits without reading the whole row
+    if(header->game_id != game_id || timestamp < header->timestamp)
         return false;
 
+    table_index::const_iterator itr_tables = tables.find(table_id);
+
     uint8_t this_player_index = 0;
-    for(Player plr: (*itr_tables).players)
+    for(const Player& plr: (*itr_tables).players)
     {
         if( plr.name == name )
             break;
@@ -3831,35 +4422,14 @@ bool pokercontract::primary_checks(eosio::name name, uint64_t table_id, uint64_t
     eosio_assert(this_player_index < (*itr_tables).players.size(),"No such user in this table");
     player_index = this_player_index;
 
-    if(timestamp < (*itr_tables).timestamp)
-    {
-        auto applied_late_trx_itr = (*itr_tables).players[this_player_index].applied_late_trxs.find(trx_index);
-        if(applied_late_trx_itr != (*itr_tables).players[this_player_index].applied_late_trxs.end())
-            return false;
-
-        tables.modify(itr_tables, _self, [&] (auto& table){
-            table.players[this_player_index].late_trxs.insert(trx_index);
-        });
-        return false;
-    }
-    
-    auto late_trx_itr = (*itr_tables).players[this_player_index].late_trxs.find(trx_index);
-    if(late_trx_itr != (*itr_tables).players[this_player_index].late_trxs.end())
-    {
-        tables.modify(itr_tables, _self, [&] (auto& table){
-            table.players[this_player_index].late_trxs.erase(trx_index);
-            table.players[this_player_index].applied_late_trxs.insert(trx_index);
-        });
-    }
-    
     return true;
 }
 
-ACTION pokercontract::shuffleddeck(eosio::name name, uint64_t table_id, uint64_t game_id, std::vector<Card> cards, uint64_t timestamp, uint32_t trx_index)
+ACTION pokercontract::shuffleddeck(eosio::name name, uint64_t table_id, uint64_t game_id, std::vector<Card>& cards, uint64_t timestamp, [[maybe_unused]] uint32_t trx_index)
 {
     eosio::print(" IN SHUFFLEDECK");
     uint8_t this_player_index;
-    if(primary_checks(name, table_id, game_id, timestamp, trx_index, this_player_index) == false)
+    if(primary_checks(name, table_id, game_id, timestamp, this_player_index) == false)
         return;
 
     auto itr_tables = tables.find(table_id);
@@ -3872,6 +4442,7 @@ ACTION pokercontract::shuffleddeck(eosio::name name, uint64_t table_id, uint64_t
     eosio::print(" player=",(*itr_tables).players[this_player_index].name);
 
     tables.modify((*itr_tables), _self, [&] (auto& table){
+                table.recordLatency(this_player_index);
                 table.setNewDeck(cards);
                 table.setNewInGameIndex(table.next_player_index, 1);
                 // T_WAIT_SHUFFLE -> T_WAIT_CRYPT
@@ -3884,12 +4455,12 @@ ACTION pokercontract::shuffleddeck(eosio::name name, uint64_t table_id, uint64_t
     });
 }
 
-ACTION pokercontract::crypteddeck(eosio::name name, uint64_t table_id, uint64_t game_id, std::vector<Card> cards, uint64_t timestamp, uint32_t trx_index, 
-                                    std::vector<Key> player_rsa_keys)
+ACTION pokercontract::crypteddeck(eosio::name name, uint64_t table_id, uint64_t game_id, std::vector<Card>& cards, uint64_t timestamp, [[maybe_unused]] uint32_t trx_index, 
+                                    std::vector<Key>& player_rsa_keys)
 {
     eosio::print(" IN CRYPTED DECK");
     uint8_t this_player_index;
-    if(primary_checks(name, table_id, game_id, timestamp, trx_index, this_player_index) == false)
+    if(primary_checks(name, table_id, game_id, timestamp, this_player_index) == false)
         return;
 
     auto itr_tables = tables.find(table_id);    
@@ -3904,7 +4475,7 @@ ACTION pokercontract::crypteddeck(eosio::name name, uint64_t table_id, uint64_t
         eosio_assert((*itr_tables).open_key.e.size() != 0, "No RSA open key");
         eosio_assert(player_rsa_keys.size() == 50, "Wrong keys count");
     
-        for(Key key: player_rsa_keys)
+        for(const Key& key: player_rsa_keys)
             if( key.card_index == (*itr_tables).players[this_player_index].cards_indexes[0] ||
                 key.card_index == (*itr_tables).players[this_player_index].cards_indexes[1] )
                     eosio_assert(false, "Wrong rsa keys indexes");
@@ -3913,16 +4484,15 @@ ACTION pokercontract::crypteddeck(eosio::name name, uint64_t table_id, uint64_t
     eosio::print(" player=",(*itr_tables).players[this_player_index].name);
 
     tables.modify(itr_tables, _self, [&] (auto& table){
+        table.recordLatency(this_player_index);
         table.setNewDeck(cards);
         table.setNewInGameIndex(table.next_player_index, 1);
 
         if(table.rsa_key_flag == 1)
         {
-            std::vector<Key> short_rsa_keys;
             uint8_t keys_count = table.current_game_players_count*2-2+5;
-            for(int i=0; i<keys_count;i++)
-                short_rsa_keys.push_back(player_rsa_keys[i]);
-            table.players_rsa_keys[name] = short_rsa_keys;
+            player_rsa_keys.resize(keys_count);
+            table.players_rsa_keys[name] = std::move(player_rsa_keys);
         }
 
         table.current_players_received_count++;
@@ -3934,11 +4504,28 @@ ACTION pokercontract::crypteddeck(eosio::name name, uint64_t table_id, uint64_t
     });
 }
 
-ACTION pokercontract::act(eosio::name name, uint64_t table_id, uint64_t game_id, Act player_act, uint64_t timestamp, uint32_t trx_index)
+ACTION pokercontract::act(eosio::name name, uint64_t table_id, uint64_t game_id, Act player_act, uint64_t timestamp, [[maybe_unused]] uint32_t trx_index)
 {
     eosio::print(" IN ACT");
+    playerAct(name, table_id, game_id, player_act, nullptr, timestamp);
+}
+
+// act with the keys of the next street cards, applied by the contract when the street closes.
+// Keys are public once sent, so only the act which closes the street can carry them: otherwise
+// a player who acts later and has the keys of all others sees the next card before deciding
+ACTION pokercontract::actwithkeys(eosio::name name, uint64_t table_id, uint64_t game_id, Act player_act, std::vector<Key>& keys, uint64_t timestamp, [[maybe_unused]] uint32_t trx_index)
+{
+    eosio::print(" IN ACT WITH KEYS");
+    std::sort(keys.begin(), keys.end(), [](const Key& a, const Key& b) -> bool{
+        return a.card_index < b.card_index;
+    });
+    playerAct(name, table_id, game_id, player_act, &keys, timestamp);
+}
+
+void pokercontract::playerAct(eosio::name name, uint64_t table_id, uint64_t game_id, Act& player_act, std::vector<Key>* keys, uint64_t timestamp)
+{
     uint8_t this_player_index;
-    if(primary_checks(name, table_id, game_id, timestamp, trx_index, this_player_index) == false)
+    if(primary_checks(name, table_id, game_id, timestamp, this_player_index) == false)
         return;
 
     auto itr_tables = tables.find(table_id);
@@ -3955,25 +4542,46 @@ ACTION pokercontract::act(eosio::name name, uint64_t table_id, uint64_t game_id,
 
     player_act.description = player_act.act_;
 
+    if(keys != nullptr)
+    {
+        std::vector<uint8_t> indexes = (*itr_tables).getNextStreetKeysIndexes();
+        eosio_assert(keys->size() == indexes.size(), "Wrong number of keys");
+        for(size_t i = 0; i < indexes.size(); i++)
+            eosio_assert((*keys)[i].card_index == indexes[i], "wrong keys indexes");
+    }
+
     tables.modify(itr_tables, _self, [&] (auto& table){
+        table.recordLatency(this_player_index);
         table.addNewAct(table.players[this_player_index], this_player_index, player_act);
         table.players[this_player_index].addNewAct(player_act);
+        table.updateSeatMasks(this_player_index);
         table.setLastTime();
         uint8_t res = table.setNextPlayerIndex();
+
+        // the transaction fails, so keys sent too early are not in the chain either
+        if(keys != nullptr)
+            eosio_assert(res == ACT_NEW_ROUND, "keys can be sent only with the act closing the betting round");
+
         if(res == T_END_GAME)
             table.endGame();
         else if(res == T_END_ALL_IN_GAME)
             table.actAllInKeys();
         else if(res == ACT_NEW_ROUND)
             table.actMasterShowDown();
+
+        // not needed after the all-in runout
+        if(keys != nullptr && table.getTableStatus() == T_WAIT_KEYS_FOR_SHOWDOWN)
+            table.applyPendingKeys(this_player_index, *keys);
     });
+
+    autoNextHand(table_id);
 }
 
-ACTION pokercontract::actfold(eosio::name name, uint64_t table_id, uint64_t game_id, std::vector<Key> keys, uint64_t timestamp, uint32_t trx_index)
+ACTION pokercontract::actfold(eosio::name name, uint64_t table_id, uint64_t game_id, std::vector<Key>& keys, uint64_t timestamp, [[maybe_unused]] uint32_t trx_index)
 {
     eosio::print(" IN ACT FOLD");
     uint8_t this_player_index;
-    if(primary_checks(name, table_id, game_id, timestamp, trx_index, this_player_index) == false)
+    if(primary_checks(name, table_id, game_id, timestamp, this_player_index) == false)
         return;
 
     auto itr_tables = tables.find(table_id);
@@ -3986,15 +4594,15 @@ ACTION pokercontract::actfold(eosio::name name, uint64_t table_id, uint64_t game
     if((*itr_tables).table_cards_indexes.empty() == false)
         waiting_start_key_index = (*itr_tables).table_cards_indexes.back() + 1;
 
-    uint32_t waiting_keys_count = the_const_deck.size() - waiting_start_key_index;
+    uint32_t waiting_keys_count = DECK_SIZE - waiting_start_key_index;
     
-    std::sort(keys.begin(), keys.end(), [](const Key a, const Key b) -> bool{
+    std::sort(keys.begin(), keys.end(), [](const Key& a, const Key& b) -> bool{
         return a.card_index < b.card_index;
     });
 
     eosio_assert(waiting_keys_count == keys.size(), "Wrong count of keys");
     auto itr_keys = keys.begin();
-    for(int i = waiting_start_key_index; i < the_const_deck.size(); i++)
+    for(int i = waiting_start_key_index; i < DECK_SIZE; i++)
     {
         eosio_assert((*itr_keys).card_index == i, "Required key index not found");
         itr_keys++;
@@ -4003,9 +4611,11 @@ ACTION pokercontract::actfold(eosio::name name, uint64_t table_id, uint64_t game
     Act act_fold = Act(ACT_FOLD, eosio::asset(0,EOS_SYMBOL));
 
     tables.modify(itr_tables, _self, [&] (auto& table){
+        table.recordLatency(this_player_index);
         table.addFoldKeys(keys);
         table.addNewAct(table.players[this_player_index], this_player_index, act_fold);
         table.players[this_player_index].addNewAct(act_fold);
+        table.updateSeatMasks(this_player_index);
         table.jobSetNextPlayerIndex();
     });
 
@@ -4014,12 +4624,14 @@ ACTION pokercontract::actfold(eosio::name name, uint64_t table_id, uint64_t game
     accounts.modify(itr_accounts, _self, [&] (auto& acnt){
         acnt.total_loss += (*itr_tables).players[this_player_index].sum_of_bets;
     });
+
+    autoNextHand(table_id);
 }
 
-ACTION pokercontract::setcardskeys(eosio::name name, uint64_t table_id, uint64_t game_id, std::vector<Key> keys, uint64_t timestamp, uint32_t trx_index)
+ACTION pokercontract::setcardskeys(eosio::name name, uint64_t table_id, uint64_t game_id, std::vector<Key>& keys, uint64_t timestamp, [[maybe_unused]] uint32_t trx_index)
 {
     uint8_t this_player_index;
-    if(primary_checks(name, table_id, game_id, timestamp, trx_index, this_player_index) == false)
+    if(primary_checks(name, table_id, game_id, timestamp, this_player_index) == false)
         return;
 
     auto itr_tables = tables.find(table_id);
@@ -4034,48 +4646,107 @@ ACTION pokercontract::setcardskeys(eosio::name name, uint64_t table_id, uint64_t
     uint8_t keys_count = (*itr_tables).getWaitingKeysCount();
     eosio_assert( keys.size() == keys_count, "Wrong number of keys");
 
-    std::sort(keys.begin(), keys.end(), [](const Key a, const Key b) -> bool{
+    std::sort(keys.begin(), keys.end(), [](const Key& a, const Key& b) -> bool{
         return a.card_index < b.card_index;
     });
 
     tables.modify(itr_tables, _self, [&] (auto& table){
         table.setEventsFromOutAndFoldPlayers();
         if(table.players[this_player_index].have_event == 0)
+        {
+            table.recordLatency(this_player_index);
             table.addNewKeys(name, this_player_index, keys);
+        }
     });
     eosio::print(" SETCARDSKEYS END. Table status = ", (int)table_status);
+
+    autoNextHand(table_id);
 }
 
-ACTION pokercontract::resettable(eosio::name name, uint64_t table_id, uint64_t game_id, uint8_t table_status, uint64_t timestamp, uint32_t trx_index)
+ACTION pokercontract::resettable(eosio::name name, uint64_t table_id, uint64_t game_id, uint8_t table_status, uint64_t timestamp, [[maybe_unused]] uint32_t trx_index)
 {
     eosio::print("resettable ", name);
-    auto itr_tables = tables.find(table_id);
-    if((*itr_tables).getTableStatus() != table_status)
-        return;
+    require_auth(name);
 
-    uint8_t this_player_index;
-    if(primary_checks(name, table_id, game_id, timestamp, trx_index, this_player_index) == false)
+    // clients send resettable before the timeout and after the game is changed,
+    // these exit on the row header without reading the whole table
+    TableHeader header;
+    eosio_assert(readTableHeader(table_id, header), "No such table");
+    if(header.table_status != table_status || header.table_status == T_WAIT_PLAYER)
         return;
 
     eosio::time_point now_time = eosio::time_point(eosio::microseconds(current_time()));
     
-    uint32_t timeout = gstate.last_timeout_sec;
-    if((*itr_tables).table_status == T_WAIT_PLAYERS_ACT)
-        timeout = gstate.warning_timeout_sec + gstate.last_timeout_sec + 5;
+    uint32_t timeout = getResetTimeout(global_cache.getState(), header.table_status, header.adaptive_timeout_sec);
 
     eosio::print("timeout=",timeout);
 
-    uint64_t time_elapsed = now_time.time_since_epoch().to_seconds() - (*itr_tables).last_act_time.time_since_epoch().to_seconds();
+    uint64_t time_elapsed = now_time.time_since_epoch().to_seconds() - header.last_act_time.time_since_epoch().to_seconds();
     eosio::print("now_time=",now_time.time_since_epoch().to_seconds());
-    eosio::print("table_time=",(*itr_tables).last_act_time.time_since_epoch().to_seconds());
+    eosio::print("table_time=",header.last_act_time.time_since_epoch().to_seconds());
     eosio::print("elapsed=",time_elapsed);
 
     if(time_elapsed < timeout)
         return;
 
-    if ((*itr_tables).table_status == T_WAIT_PLAYER)
+    uint8_t this_player_index;
+    if(primary_checks(name, table_id, game_id, timestamp, this_player_index, &header) == false)
         return;
 
+    resetTable(name, table_id, time_elapsed, timeout);
+}
+
+// permissionless: resets up to max_count tables expired by bylasttime, oldest first
+ACTION pokercontract::sweep(uint32_t max_count)
+{
+    eosio_assert(max_count > 0 && max_count <= SWEEP_MAX_TABLES, "wrong max_count");
+    eosio_assert(global_cache.stateExists(), "globalstate is not initialized");
+
+    const globalstate& gstate = global_cache.getState();
+    uint64_t now_sec = eosio::microseconds(current_time()).to_seconds();
+
+    // resetTable moves rows in the index, so collect them first
+    std::vector<uint64_t> ids;
+    std::vector<uint64_t> elapsed;
+    std::vector<uint32_t> timeouts;
+
+    auto by_time = tables.get_index<"bylasttime"_n>();
+    uint32_t scanned = 0;
+    for(auto itr = by_time.begin(); itr != by_time.end() && ids.size() < max_count && scanned < SWEEP_MAX_SCAN; itr++, scanned++)
+    {
+        // the rest are waiting and parked tables
+        if(itr->by_last_act_time() == std::numeric_limits<uint64_t>::max())
+            break;
+
+        uint64_t time_elapsed = now_sec - (*itr).last_act_time.time_since_epoch().to_seconds();
+
+        // the shortest timeout: all the next tables are newer
+        if(time_elapsed < gstate.last_timeout_sec && time_elapsed < ADAPTIVE_TIMEOUT_MIN_SEC)
+            break;
+
+        uint32_t timeout = getResetTimeout(gstate, (*itr).getTableStatus(), (*itr).adaptive_timeout_sec);
+        if(time_elapsed < timeout)
+            continue;
+
+        ids.push_back((*itr).id);
+        elapsed.push_back(time_elapsed);
+        timeouts.push_back(timeout);
+    }
+
+    eosio_assert(ids.size() > 0, "no expired tables");
+
+    for(size_t i = 0; i < ids.size(); i++)
+        resetTable(eosio::name(), ids[i], elapsed[i], timeouts[i]);
+}
+
+// timeouts, penalties and refunds of the expired table. name is the player who asked
+// for the reset, he keeps his seat on a dead table; empty for sweep
+void pokercontract::resetTable(eosio::name name, uint64_t table_id, uint64_t time_elapsed, uint32_t timeout)
+{
+    const globalstate& gstate = global_cache.getState();
+    auto itr_tables = tables.find(table_id);
+    AccountDeltas deltas;
+
     tables.modify(itr_tables, _self, [&] (auto& table){
 
         if(time_elapsed >= timeout + gstate.delete_table_timeout_sec)
@@ -4087,7 +4758,7 @@ ACTION pokercontract::resettable(eosio::name name, uint64_t table_id, uint64_t g
             // return money
             for(Player& plr: table.players)
             {
-                if(plr.name == name || plr.status == P_NO_PLAYER || plr.status == P_OUT)
+                if(plr.status == P_NO_PLAYER || plr.status == P_OUT || plr.name == name)
                     continue;
 
                 auto itr_accounts = accounts.find(plr.name.value);
@@ -4125,7 +4796,7 @@ ACTION pokercontract::resettable(eosio::name name, uint64_t table_id, uint64_t g
         std::vector<uint8_t> new_timeout, in_game;
         bool set_penalty_asset = table.getPenaltyAssetFlag();
 
-        table.setPlayersTimeoutsAndPenalty(set_penalty_asset, new_timeout, in_game);
+        table.setPlayersTimeoutsAndPenalty(set_penalty_asset, new_timeout, in_game, deltas);
 
         if(table.table_status == T_WAIT_END_GAME)
         {
@@ -4155,12 +4826,6 @@ ACTION pokercontract::resettable(eosio::name name, uint64_t table_id, uint64_t g
             table.saved_table_status = table.table_status;
             table.setTableStatus(T_WAIT_RSA_KEYS);
             table.setLastTime();
-            
-            for(Player& plr: table.players)
-            {
-                plr.late_trxs.clear();
-                plr.applied_late_trxs.clear();
-            }
             return;
         }
 
@@ -4208,17 +4873,10 @@ ACTION pokercontract::resettable(eosio::name name, uint64_t table_id, uint64_t g
                     master_pay_total = table.current_bank - plr_fine_part*in_game.size();
 
                     for(uint8_t i: in_game)
-                    {
-                        auto itr_accounts = accounts.find(table.players[i].name.value);
-                        eosio_assert(itr_accounts != accounts.end(), "No such user");
-                        accounts.modify(itr_accounts, _self, [&] (auto& acnt){
-                            acnt.quantity_ += plr_fine_part;
-                        });
-                    }    
+                        deltas.get(table.players[i].name).quantity += plr_fine_part;
                 }
 
-                gfine.fine_value += master_pay_total;
-                global_fine.set(gfine, _self);
+                addRakeShard(table.id, eosio::asset(0, EOS_SYMBOL), eosio::asset(0, EOS_SYMBOL), master_pay_total);
             }
 
             table.resettableGameStatistic();
@@ -4229,19 +4887,26 @@ ACTION pokercontract::resettable(eosio::name name, uint64_t table_id, uint64_t g
         }
     });
 
+    deltas.apply();
+
     // delete table if no players
     if((*itr_tables).getTableStatus() == T_DELETE)
-        tables.erase(itr_tables);
+    {
+        releaseTable(itr_tables);
+        return;
+    }
+
+    autoNextHand(table_id);
 }
 
-ACTION pokercontract::sendendgame(eosio::name name, uint64_t table_id, uint64_t game_id, uint64_t timestamp, uint32_t trx_index)
+ACTION pokercontract::sendendgame(eosio::name name, uint64_t table_id, uint64_t game_id, uint64_t timestamp, [[maybe_unused]] uint32_t trx_index)
 {
     eosio::print(" IN SENDENDGAME ", name);
-    globalstate gstate = global.get();
-    eosio_assert(gstate.freezing == 0, "contract status is freezing");
+    eosio_assert(global_cache.stateExists(), "globalstate is not initialized");
+    eosio_assert(global_cache.getState().freezing == 0, "contract status is freezing");
 
     uint8_t this_player_index;
-    if(primary_checks(name, table_id, game_id, timestamp, trx_index, this_player_index) == false)
+    if(primary_checks(name, table_id, game_id, timestamp, this_player_index) == false)
         return;
 
     auto itr_tables = tables.find(table_id);
@@ -4259,26 +4924,21 @@ ACTION pokercontract::sendendgame(eosio::name name, uint64_t table_id, uint64_t
         table.players[this_player_index].have_event = 1;
 
         if(++table.current_players_received_count == table.current_game_players_count)
-        {
-            bool move_dealer = true;
-            if(table.history.back().result == R_TIMEOUT_RESET)
-                move_dealer = false;
-            table.initNewGame(move_dealer);
-        }
+            table.nextGame();
     });
     
     if((*itr_tables).getTableStatus() == T_DELETE)
-        tables.erase(itr_tables);
+        releaseTable(itr_tables);
 }
 
-ACTION pokercontract::sendnewgame(eosio::name name, uint64_t table_id, uint64_t game_id, uint64_t timestamp, uint32_t trx_index)
+ACTION pokercontract::sendnewgame(eosio::name name, uint64_t table_id, uint64_t game_id, uint64_t timestamp, [[maybe_unused]] uint32_t trx_index)
 {
     eosio::print(" IN SENDNEWGAME ", name);
-    globalstate gstate = global.get();
-    eosio_assert(gstate.freezing == 0, "contract status is freezing");
+    eosio_assert(global_cache.stateExists(), "globalstate is not initialized");
+    eosio_assert(global_cache.getState().freezing == 0, "contract status is freezing");
 
     uint8_t this_player_index;
-    if(primary_checks(name, table_id, game_id, timestamp, trx_index, this_player_index) == false)
+    if(primary_checks(name, table_id, game_id, timestamp, this_player_index) == false)
         return;
 
     auto itr_tables = tables.find(table_id);
@@ -4299,15 +4959,7 @@ ACTION pokercontract::sendnewgame(eosio::name name, uint64_t table_id, uint64_t
         table.players[this_player_index].have_event = 1;
 
         if(++table.current_players_received_count == table.current_game_players_count)
-        {
-            table.current_players_received_count = 0;
-            // T_WAIT_NEW_GAME -> T_WAIT_SHUFFLE
-            table.setTableStatus(T_WAIT_SHUFFLE);
-            
-            for(Player& plr: table.players)
-                plr.have_event = 0;
-            table.setLastTime();
-        }
+            table.startShuffle();
     });
 }
 
@@ -4321,6 +4973,10 @@ ACTION pokercontract::clear(name owner, uint64_t count)
     auto tables_it = tables.begin();
     while( tables_it != tables.end())
     {
+        count -= eraseTableScopes((*tables_it).id, count);
+        if(count == 0)
+            return;
+
         tables_it = tables.erase(tables_it);
         if(--count == 0)
             return;
@@ -4343,6 +4999,15 @@ ACTION pokercontract::clear(name owner, uint64_t count)
             return;
     }
 
+    rake_shard_index rakeshards(contractname,contractname.value);
+    auto shards_it = rakeshards.begin();
+    while( shards_it != rakeshards.end())
+    {
+        shards_it = rakeshards.erase(shards_it);
+        if(--count == 0)
+            return;
+    }
+
     global.remove();
 }
 
@@ -4353,16 +5018,170 @@ ACTION pokercontract::clearstats(name owner, uint64_t count)
     eosio_assert(owner == _self, "Only owner can clear gamesstats");
     name contractname(CONTRACTNAME);
 
-    statistic_index gamesstats(contractname,contractname.value);
-    auto stats_it = gamesstats.begin();
-    while( stats_it != gamesstats.end())
+    // rows of contract scope have the legacy layout, removed without decoding
+    int32_t itr = db_lowerbound_i64(contractname.value, contractname.value, "gamesstats"_n.value, 0);
+    while(itr >= 0)
     {
-        stats_it = gamesstats.erase(stats_it);
+        uint64_t next_id = 0;
+        int32_t itr_next = db_next_i64(itr, &next_id);
+        db_remove_i64(itr);
+        itr = itr_next;
         if(--count == 0)
             return;
     }
 }
 
+// legacy row to the packed layout in its day scope, with a new id of that day
+void moveLegacyGameStatistic(const GamesStatisticLegacy& legacy)
+{
+    name contractname(CONTRACTNAME);
+    uint64_t day = legacy.start_time.sec_since_epoch() / STATS_DAY_SEC;
+
+    statistic_day_index statsdays(contractname,contractname.value);
+    if(statsdays.find(day) == statsdays.end())
+    {
+        statsdays.emplace(contractname, [&] (auto& stat_day) {
+            stat_day.day = day;
+        });
+    }
+
+    PackedGameStat stat;
+    for(const Card& card: legacy.table_cards)
+        stat.table_cards.push_back(packCardIndex(card.suit, card.value));
+
+    for(const PlayerHistoryInfo& info: legacy.players_info)
+    {
+        PackedPlayerStat packed;
+        packPlayerHistoryInfo(info, packed);
+        stat.players.push_back(packed);
+    }
+
+    for(const eosio::name& timeout_name: legacy.timeout_players)
+    {
+        PackedPlayerStat packed;
+        packed.name = timeout_name.value;
+        packed.flags = PS_TIMEOUT;
+        stat.players.push_back(packed);
+    }
+
+    statistic_index gamesstats(contractname,day);
+    uint64_t new_game_id = gamesstats.available_primary_key();
+    if(new_game_id < (day << STATS_DAY_SHIFT))
+        new_game_id = day << STATS_DAY_SHIFT;
+
+    gamesstats.emplace(contractname, [&] (auto& game) {
+        game.id = new_game_id;
+        game.start_time = legacy.start_time;
+        game.end_time = legacy.end_time;
+        game.small_blind = legacy.small_blind;
+        game.players_count = legacy.players_count;
+        game.bank = legacy.bank;
+        game.rake = legacy.rake;
+        game.result_table_status = legacy.result_table_status;
+        game.status = legacy.status;
+        encodeGameStat(stat, game.data);
+    });
+
+    updateStatisticDay(day, legacy.status, legacy.bank, legacy.rake);
+}
+
+// one-shot: gamesstats rows of contract scope, written before the partitioning by day,
+// are moved to their day scopes in the packed layout
+ACTION pokercontract::migratestats(name owner, uint64_t count)
+{
+    require_auth(owner);
+
+    eosio_assert(owner == _self, "Only owner can migrate gamesstats");
+    eosio_assert(count > 0, "count must be positive");
+    name contractname(CONTRACTNAME);
+
+    int32_t itr = db_lowerbound_i64(contractname.value, contractname.value, "gamesstats"_n.value, 0);
+    while(itr >= 0 && count-- > 0)
+    {
+        int32_t size = db_get_i64(itr, nullptr, 0);
+        std::vector<char> buffer(size);
+        db_get_i64(itr, buffer.data(), size);
+        GamesStatisticLegacy legacy = eosio::unpack<GamesStatisticLegacy>(buffer);
+
+        uint64_t next_id = 0;
+        int32_t itr_next = db_next_i64(itr, &next_id);
+        db_remove_i64(itr);
+        itr = itr_next;
+
+        // hand of the old contract still going: its table never writes the result, dropped
+        if(legacy.status != R_IN_GAME)
+            moveLegacyGameStatistic(legacy);
+    }
+
+    if(itr >= 0)
+        eosio::print("Have more gamesstats to migrate");
+    else
+        eosio::print("All gamesstats migrated");
+}
+
+// gamesstats rows are kept only for last keep_days days, statsdays rows are kept forever
+ACTION pokercontract::expirestats(name owner, uint32_t keep_days, uint64_t count)
+{
+    require_auth(owner);
+
+    eosio_assert(owner == _self, "Only owner can expire gamesstats");
+    eosio_assert(keep_days >= 1, "keep_days must be greater or equal 1");
+    eosio_assert(count > 0, "count must be positive");
+    name contractname(CONTRACTNAME);
+
+    eosio::time_point now_time = eosio::time_point(eosio::microseconds(current_time()));
+    uint64_t today = now_time.sec_since_epoch() / STATS_DAY_SEC;
+
+    statistic_day_index statsdays(contractname,contractname.value);
+    for(auto itr_day = statsdays.begin(); itr_day != statsdays.end(); itr_day++)
+    {
+        if((*itr_day).day + keep_days > today)
+            break; // days sorted by primary key, all next days are fresh
+
+        if((*itr_day).expired == 1)
+            continue;
+
+        // a hand started before midnight can be still going, its table writes the row at the end.
+        // Rows of older days still in game are left by erased tables, nobody writes them
+        bool in_game = false;
+        bool yesterday = (*itr_day).day + 1 >= today;
+        statistic_index gamesstats(contractname,(*itr_day).day);
+        auto stats_it = gamesstats.begin();
+        while( stats_it != gamesstats.end())
+        {
+            if((*stats_it).status == R_IN_GAME && yesterday)
+            {
+                in_game = true;
+                stats_it++;
+            }
+            else
+                stats_it = gamesstats.erase(stats_it);
+
+            if(--count == 0)
+            {
+                eosio::print("Have more expired gamesstats");
+                return;
+            }
+        }
+
+        if(in_game)
+            continue; // expired by a next call, when these hands end
+
+        statsdays.modify(itr_day, contractname, [&] (auto& stat_day){
+            stat_day.expired = 1;
+        });
+    }
+    eosio::print("All expired gamesstats cleared");
+}
+
+// sent inline by the contract itself when a game ends, see sendGameResult. Nothing to do
+ACTION pokercontract::gameresult([[maybe_unused]] uint64_t game_id, [[maybe_unused]] eosio::asset small_blind,
+                                 [[maybe_unused]] eosio::asset bank, [[maybe_unused]] eosio::asset rake,
+                                 [[maybe_unused]] uint8_t status, [[maybe_unused]] std::vector<uint8_t> data)
+{
+    require_auth(_self);
+}
+
 ACTION pokercontract::cleargamesid(eosio::name owner, uint64_t count)
 {
     require_auth(owner);
@@ -4421,10 +5240,8 @@ bool Table::getTimeoutType()
     return many_players_timeout;
 }
 
-void Table::setPlayersTimeoutsAndPenalty(bool set_penalty, std::vector<uint8_t>& new_timeout, std::vector<uint8_t>& in_game)
+void Table::setPlayersTimeoutsAndPenalty(bool set_penalty, std::vector<uint8_t>& new_timeout, std::vector<uint8_t>& in_game, AccountDeltas& deltas)
 {
-    eosio::name contractname(CONTRACTNAME);
-    account_index   accounts(contractname,contractname.value);
     bool many_players_timeout = getTimeoutType();
     uint8_t count = current_game_players_count;
     uint8_t i = next_player_index;
@@ -4440,7 +5257,7 @@ void Table::setPlayersTimeoutsAndPenalty(bool set_penalty, std::vector<uint8_t>&
         if( ((many_players_timeout == true) && (players[i].have_event == 0)) ||
             ((many_players_timeout == false) && (next_player_index == i)) )
         {
-            players[i].status = P_TIMEOUT;
+            setPlayerStatus(i, P_TIMEOUT);
             if(rsa_key_flag == 1)
                 players[i].wait_rsa = 1;
 
@@ -4450,14 +5267,11 @@ void Table::setPlayersTimeoutsAndPenalty(bool set_penalty, std::vector<uint8_t>&
 
             new_timeout.push_back(i);
 
-            auto itr_accounts = accounts.find(players[i].name.value);
-            eosio_assert(itr_accounts != accounts.end(), "No such user");
-            accounts.modify(itr_accounts, contractname, [&] (auto& acnt){
-                if(set_penalty == true)
-                    acnt.penalty += players[i].sum_of_bets;
+            AccountDelta& delta = deltas.get(players[i].name);
+            if(set_penalty == true)
+                delta.penalty += players[i].sum_of_bets;
 
-                acnt.penalty_count++;
-            });
+            delta.penalty_count++;
         }
         else
             in_game.push_back(i);
@@ -4468,13 +5282,50 @@ void Table::setPlayersTimeoutsAndPenalty(bool set_penalty, std::vector<uint8_t>&
     // no chance for normal end of game
     if( (set_penalty == false) && (in_game.size() == 0) )
         for(uint8_t i: in_game)
-        {
-            auto itr_accounts = accounts.find(players[i].name.value);
-            eosio_assert(itr_accounts != accounts.end(), "No such user");
-            accounts.modify(itr_accounts, contractname, [&] (auto& acnt){
-                    acnt.penalty += players[i].sum_of_bets;
-            });            
-        }
+            deltas.get(players[i].name).penalty += players[i].sum_of_bets;
+}
+
+AccountDelta& AccountDeltas::get(eosio::name name)
+{
+    for(AccountDelta& delta: deltas)
+        if(delta.name == name)
+            return delta;
+
+    deltas.emplace_back();
+    deltas.back().name = name;
+    return deltas.back();
+}
+
+void AccountDeltas::apply()
+{
+    eosio::name contractname(CONTRACTNAME);
+    account_index   accounts(contractname,contractname.value);
+
+    for(const AccountDelta& delta: deltas)
+    {
+        auto itr_accounts = accounts.find(delta.name.value);
+        eosio_assert(itr_accounts != accounts.end(), "No such user");
+        accounts.modify(itr_accounts, contractname, [&] (auto& acnt){
+            acnt.quantity_ += delta.quantity;
+            acnt.penalty += delta.penalty;
+            acnt.penalty_count += delta.penalty_count;
+            acnt.count_of_wins += delta.count_of_wins;
+            acnt.count_of_defeats += delta.count_of_defeats;
+            acnt.total_win += delta.total_win;
+            acnt.total_loss += delta.total_loss;
+            acnt.rake += delta.rake;
+
+            if(!delta.latency.empty())
+                acnt.addLatency(delta.latency);
+
+            if(delta.init_reserve && acnt.reserve.size() == 0)
+            {
+                acnt.reserve.push_back(eosio::asset(0, EOS_SYMBOL));
+                acnt.reserve.push_back(eosio::asset(0, EOS_SYMBOL));
+            }
+        });
+    }
+    deltas.clear();
 }
 
 ACTION pokercontract::withdraw(eosio::name name)
@@ -4525,6 +5376,13 @@ ACTION pokercontract::testrake(eosio::name name)
     globalstate gstate = global.get();
     gstate.r = users_rakes;
     global.set(gstate, _self);
+
+    // users rake already has not flushed rake
+    rake_shard_index rakeshards(_self, _self.value);
+    for(auto itr_shard = rakeshards.begin(); itr_shard != rakeshards.end(); itr_shard++ )
+        rakeshards.modify(itr_shard, _self, [&] (auto& shard){
+            shard.r = eosio::asset(0, EOS_SYMBOL);
+        });
 /*********************************************************************/
 }
 
@@ -4669,28 +5527,38 @@ ACTION pokercontract::sendmsg(eosio::name name, uint64_t table_id, uint64_t game
 {
     require_auth(name);
 
-    eosio_assert(msg.length() <= 100, "Message is too long");
+    eosio_assert(msg.length() <= CHAT_MESSAGE_SIZE, "Message is too long");
 
     auto itr_accounts = accounts.find(name.value);
     eosio_assert(itr_accounts != accounts.end(), "No such user");
     eosio_assert(table_id ==  (*itr_accounts).getTableId(), "Wrong table id");
 
-    auto itr_tables = tables.find(table_id);
-    eosio_assert(itr_tables != tables.end(), "No such table");
+    TableHeader header;
+    eosio_assert(readTableHeader(table_id, header), "No such table");
 
-    std::string auth_msg = name.to_string() + ": " + msg;
+    chat_message_index chatmsgs(_self, table_id);
+    uint64_t seq = 0;
+    auto itr_last = chatmsgs.end();
+    if(itr_last != chatmsgs.begin())
+        seq = (*(--itr_last)).seq + 1;
 
-    tables.modify(itr_tables, _self, [&] (auto& table){
-        if(table.history.size() == 0)
-        {
-            GameResult res;
-            table.history.push_back(res);
-        }
-        table.history.back().log.push_back(auth_msg);
+    if(seq >= CHAT_MESSAGES_MAX)
+    {
+        auto itr_old = chatmsgs.find(seq - CHAT_MESSAGES_MAX);
+        if(itr_old != chatmsgs.end())
+            chatmsgs.erase(itr_old);
+    }
+
+    chatmsgs.emplace(_self, [&] (auto& chat_msg){
+        chat_msg.seq = seq;
+        chat_msg.game_id = header.game_id;
+        chat_msg.name = name;
+        chat_msg.msg = msg;
+        chat_msg.time = eosio::time_point(eosio::microseconds(current_time()));
     });
 }
 
-ACTION pokercontract::setrsakeys(eosio::name name, uint64_t table_id, uint64_t game_id, std::map<eosio::name, std::vector<Key>> players_keys)
+ACTION pokercontract::setrsakeys(eosio::name name, uint64_t table_id, uint64_t game_id, std::map<eosio::name, std::vector<Key>>& players_keys)
 {
     require_auth(name);
 
@@ -4707,6 +5575,8 @@ ACTION pokercontract::setrsakeys(eosio::name name, uint64_t table_id, uint64_t g
         table.setBlackBoxKeys(players_keys);
     });
 
+    autoNextHand(table_id);
+
 }
 
 ACTION pokercontract::setopenkey(eosio::name name, uint64_t table_id, RsaOpenKey open_key)
@@ -4772,6 +5642,32 @@ ACTION pokercontract::setnewref(eosio::name owner, std::vector<eosio::name> refe
     }
 }
 
+// anybody can fold rake shards of tables into the global totals
+ACTION pokercontract::flushrake(eosio::name name, uint64_t count)
+{
+    require_auth(name);
+    eosio_assert(global_cache.stateExists(), "globalstate is not initialized");
+    eosio_assert(count > 0, "count must be positive");
+
+    rake_shard_index rakeshards(_self, _self.value);
+    auto itr_shard = rakeshards.begin();
+    if(itr_shard == rakeshards.end())
+        return;
+
+    globalstate& gstate = global_cache.getState();
+    globalfine& gfine = global_cache.getFine();
+    while( itr_shard != rakeshards.end() && count-- > 0)
+    {
+        gstate.r += (*itr_shard).r;
+        gfine.u += (*itr_shard).u;
+        gfine.fine_value += (*itr_shard).fine_value;
+        itr_shard = rakeshards.erase(itr_shard);
+    }
+
+    global_cache.saveState(_self);
+    global_cache.saveFine(_self);
+}
+
 #undef EOSIO_DISPATCH
 
 #define EOSIO_DISPATCH( TYPE, MEMBERS ) \
@@ -4797,25 +5693,34 @@ extern "C" { \
 EOSIO_DISPATCH(pokercontract,   (init) 
                                 (clear) 
                                 (clearstats)
+                                (expirestats)
+                                (migratestats)
+                                (gameresult)
                                 (setparams)
+                                (migraterake)
                                 (transfer) 
                                 (connecttable) 
                                 (outfromtable) 
                                 (shuffleddeck) 
                                 (crypteddeck) 
                                 (act)
+                                (actwithkeys)
                                 (actfold) 
                                 (setcardskeys) 
                                 (resettable) 
+                                (sweep)
                                 (sendendgame)
                                 (sendnewgame)
                                 (withdraw)
                                 (testcombos)
                                 (testrake)
                                 (cleargamesid)
+                                (flushrake)
                                 (sendmsg)
                                 (setopenkey)
                                 (setrsakeys)
                                 (setref)
                                 (setnewref)
+                                (setpool)
+                                (warmpool)
                                 )
\ No newline at end of file
@@ -8,8 +8,15 @@
 #include <eosiolib/asset.hpp>
 #include <eosiolib/time.hpp>
 #include <eosiolib/symbol.hpp>
+#include <eosiolib/binary_extension.hpp>
+#include <new>
+#include <type_traits>
 #include "card.hpp"
 #include "combinations.hpp"
+#include "stats_codec.hpp"
+#include "moves.hpp"
+#include "latency.hpp"
+#include "seats.hpp"
 
 using namespace eosio;
 
@@ -19,6 +26,14 @@ using namespace eosio;
 #define BLACKBOXACNT "dcdpblackbox"
 #define referal_check "referal"
 
+#define BP_DENOMINATOR      10000   // basis points
+#define RAKE_BP_VERSION     394     // globalstate version with rake_bp instead of float rake_percent
+#ifndef CONTRACT_STATE_STORAGE
+#define CONTRACT_STATE_STORAGE      // thread_local for native tools running a chain per thread
+#endif
+#define STATS_DAY_SEC       86400
+#define STATS_DAY_SHIFT     32  // game_id = day << STATS_DAY_SHIFT | number of game in this day
+
 struct [[eosio::table, eosio::contract("pokercontract")]]
 Account
 {
@@ -39,6 +54,8 @@ Account
     eosio::asset            penalty = eosio::asset(0, EOS_SYMBOL);
     std::vector<eosio::name>    referal_name;
     std::vector<eosio::asset>   reserve;
+    // LatencyPhase x LATENCY_BUCKETS, see latency.hpp. Extension: rows written before it have none
+    eosio::binary_extension<std::vector<uint16_t>> latency_hist;
 
     uint64_t primary_key() const { return name_.value;}
 
@@ -52,20 +69,36 @@ Account
 
     eosio::asset getBalance() const;
     void addBalance(eosio::asset quantity);
+
+    uint32_t getLatencyTimeout() const;
+    void addLatency(const std::vector<uint8_t>& hand);
+};
+
+// changes of one account collected during a table action
+struct AccountDelta
+{
+    eosio::name             name;
+    eosio::asset            quantity = eosio::asset(0, EOS_SYMBOL);
+    eosio::asset            penalty = eosio::asset(0, EOS_SYMBOL);
+    uint32_t                penalty_count = 0;
+    uint32_t                count_of_wins = 0;
+    uint32_t                count_of_defeats = 0;
+    eosio::asset            total_win = eosio::asset(0, EOS_SYMBOL);
+    eosio::asset            total_loss = eosio::asset(0, EOS_SYMBOL);
+    eosio::asset            rake = eosio::asset(0, EOS_SYMBOL);
+    bool                    init_reserve = false;
+    std::vector<uint8_t>    latency;
 };
 
-enum ActTypes
+// one accounts.modify per account instead of one per change
+class AccountDeltas
 {
-    ACT_SMALL_BLIND,
-    ACT_BIG_BLIND,
-    ACT_BET, // includes CALL and RAISE // 2
-    ACT_FOLD,
-    ACT_CHECK,
-    ACT_NEW_ROUND,
-    // descriptions
-    ACT_CALL,
-    ACT_RISE, // 7
-    ACT_ALLIN
+    public:
+        AccountDelta& get(eosio::name name);
+        void apply();
+
+    private:
+        std::vector<AccountDelta> deltas;
 };
 
 struct Act
@@ -160,8 +193,7 @@ struct Player
     std::vector<uint8_t>    cards_indexes;
     std::vector<Act>        acts;
     uint8_t                 all_in_flag = 0;
-    std::set<uint32_t>      late_trxs;
-    std::set<uint32_t>      applied_late_trxs;
+    std::vector<uint8_t>    latency;        // this hand, LatencyPhase x LATENCY_BUCKETS
 
     void clearGameInfo();
     void addNewAct(const Act& act);
@@ -183,8 +215,7 @@ struct Player
                             (cards_indexes)
                             (acts)
                             (all_in_flag)
-                            (late_trxs)
-                            (applied_late_trxs))
+                            (latency))
 };
 
 enum TableStatus
@@ -205,9 +236,29 @@ enum TableStatus
     T_WAIT_END_GAME,
     T_END_ALL_IN_GAME,
     T_DELETE,
-    T_WAIT_RSA_KEYS
+    T_WAIT_RSA_KEYS,
+    T_PARKED        // empty row in the pool, reused by connecttable for the same small blind
+};
+
+enum TableFlags
+{
+    TF_AUTO_NEXT_HAND   = 0x01, // next hand starts after endGame, no sendendgame and sendnewgame
+    TF_ADAPTIVE_TIMEOUT = 0x02  // timeouts from latency histograms of the players, see latency.hpp
 };
 
+#define TF_ALL  (TF_AUTO_NEXT_HAND | TF_ADAPTIVE_TIMEOUT)
+
+// setTableStatus time of the current hand, for TableTrace and GamesStatistic::phase_ms
+struct PhaseMark
+{
+    uint8_t                 table_status = 0;
+    eosio::time_point       time;
+
+    EOSLIB_SERIALIZE(PhaseMark, (table_status) (time))
+};
+
+#define PHASE_MARKS_MAX     32
+
 struct SidePot
 {
     eosio::asset    bank;
@@ -241,26 +292,27 @@ struct GameResult
 {
     uint8_t                         result;
     eosio::asset                    start_bank = eosio::asset(0, EOS_SYMBOL);
-    float                           rake_percent = 0;
+    uint32_t                        rake_bp = 0; // effective, lower than globalstate::rake_bp if rake is capped
     eosio::asset                    bank_rake_asset = eosio::asset(0, EOS_SYMBOL);
     eosio::asset                    referal_rake_asset = eosio::asset(0, EOS_SYMBOL);
     eosio::asset                    bank_unconsumed = eosio::asset(0, EOS_SYMBOL);
     eosio::asset                    bank = eosio::asset(0, EOS_SYMBOL);
     std::vector<PlayerHistoryInfo>  players_info;
-    std::vector<std::string>        log;
 
     EOSLIB_SERIALIZE(GameResult,    (result)
                                     (start_bank)
-                                    (rake_percent)
+                                    (rake_bp)
                                     (bank_rake_asset)
                                     (referal_rake_asset)
                                     (bank_unconsumed)
                                     (bank)
-                                    (players_info)
-                                    (log)) 
+                                    (players_info)) 
 };
 
-const std::vector<Card> the_const_deck = 
+#define DECK_SIZE 52
+
+// constexpr: read-only data of the wasm, no static initializer run on every action
+constexpr Card the_const_deck[DECK_SIZE] = 
 {Card(0,2), Card(0,3), Card(0,4), Card(0,5), Card(0,6), Card(0,7), Card(0,8), Card(0,9), Card(0,10), Card(0,11), Card(0,12), Card(0,13), Card(0,14),
  Card(1,2), Card(1,3), Card(1,4), Card(1,5), Card(1,6), Card(1,7), Card(1,8), Card(1,9), Card(1,10), Card(1,11), Card(1,12), Card(1,13), Card(1,14),
  Card(2,2), Card(2,3), Card(2,4), Card(2,5), Card(2,6), Card(2,7), Card(2,8), Card(2,9), Card(2,10), Card(2,11), Card(2,12), Card(2,13), Card(2,14),
@@ -268,6 +320,25 @@ const std::vector<Card> the_const_deck =
 
 struct [[eosio::table, eosio::contract("pokercontract")]]
 GamesStatistic
+{
+    uint64_t                        id;
+    eosio::time_point               start_time;
+    eosio::time_point               end_time;
+    eosio::asset                    small_blind;
+    uint8_t                         players_count;
+    eosio::asset                    bank;
+    eosio::asset                    rake;
+    std::vector<eosio::name>        players; // only while the game is going
+    uint8_t                         result_table_status;
+    uint8_t                         status = 0;
+    std::vector<uint8_t>            data; // PackedGameStat, see stats_codec.hpp
+    std::vector<uint32_t>           phase_ms; // milliseconds in every TableStatus, index = status
+    
+    uint64_t primary_key() const { return id;}
+};
+
+// GamesStatistic before the packed data, rows left in gamesstats contract scope, only for migratestats
+struct GamesStatisticLegacy
 {
     uint64_t                        id;
     eosio::time_point               start_time;
@@ -282,8 +353,102 @@ GamesStatistic
     uint8_t                         result_table_status;
     uint8_t                         status = 0;
     std::vector<eosio::name>        timeout_players;
-    
-    uint64_t primary_key() const { return id;}
+
+    EOSLIB_SERIALIZE(GamesStatisticLegacy, (id) (start_time) (end_time) (small_blind) (players_count) (bank) (rake)
+                                           (table_cards) (players) (players_info) (result_table_status) (status) (timeout_players))
+};
+
+// one row per day in contract scope, games of this day are in gamesstats scope = day
+struct [[eosio::table, eosio::contract("pokercontract")]]
+StatisticDay
+{
+    uint64_t                        day;
+    uint32_t                        games_count = 0;
+    uint32_t                        normal_count = 0;
+    uint32_t                        timeout_reset_count = 0;
+    uint32_t                        dead_table_count = 0;
+    eosio::asset                    bank = eosio::asset(0, EOS_SYMBOL);
+    eosio::asset                    rake = eosio::asset(0, EOS_SYMBOL);
+    uint8_t                         expired = 0;
+
+    uint64_t primary_key() const { return day;}
+};
+
+// fixed size beginning of a Table row, enough for precondition checks of late and stale actions
+struct TableHeader
+{
+    uint64_t                id = 0;
+    uint64_t                game_id = 0;
+    uint8_t                 table_status = 0;
+    eosio::time_point       last_act_time;
+    uint64_t                timestamp = 0;
+    uint32_t                adaptive_timeout_sec = 0;
+
+    EOSLIB_SERIALIZE(TableHeader, (id) (game_id) (table_status) (last_act_time) (timestamp) (adaptive_timeout_sec))
+};
+
+#define TABLE_HEADER_SIZE   37
+
+bool readTableHeader(uint64_t table_id, TableHeader& header);
+
+enum TableEventType
+{
+    E_ACT,          // player act or blind, act and amount of PlayerAct
+    E_NEW_ROUND,    // next street dealt
+    E_STATUS,       // table_status changed: keys needed, waiting act, etc.
+    E_END_GAME      // amount = bank of the hand, result in Table::history
+};
+
+#define TABLE_EVENTS_MAX    128 // events kept per table, older are erased
+
+// tableevents, scope = table id. Clients poll rows after their last seq
+// instead of reading the whole Table row
+struct [[eosio::table, eosio::contract("pokercontract")]]
+TableEvent
+{
+    uint64_t                seq;
+    uint64_t                game_id;
+    uint8_t                 type;
+    uint8_t                 table_status;
+    uint8_t                 player_index = 0;
+    eosio::name             name;
+    uint8_t                 act = 0;
+    eosio::asset            amount = eosio::asset(0, EOS_SYMBOL);
+    eosio::time_point       time;
+
+    uint64_t primary_key() const { return seq;}
+};
+
+#define CHAT_MESSAGES_MAX   32  // messages kept per table, older are erased
+#define CHAT_MESSAGE_SIZE   100
+
+// chatmsgs, scope = table id, ring buffer of the last CHAT_MESSAGES_MAX messages
+// so chat doesn't grow and rewrite the Table row
+struct [[eosio::table, eosio::contract("pokercontract")]]
+ChatMessage
+{
+    uint64_t                seq;
+    uint64_t                game_id;
+    eosio::name             name;
+    std::string             msg;
+    eosio::time_point       time;
+
+    uint64_t primary_key() const { return seq;}
+};
+
+#define TABLE_TRACE_MAX     64  // hands kept per table, older are erased
+
+// tabletrace, scope = table id. Status transitions of the last TABLE_TRACE_MAX hands,
+// for operators looking where the time of a hand goes
+struct [[eosio::table, eosio::contract("pokercontract")]]
+TableTrace
+{
+    uint64_t                seq;
+    uint64_t                game_id;
+    std::vector<PhaseMark>  marks;
+    eosio::time_point       end_time;
+
+    uint64_t primary_key() const { return seq;}
 };
 
 struct Debug
@@ -295,18 +460,24 @@ uint8_t     table_status;
 struct [[eosio::table, eosio::contract("pokercontract")]]
 Table
 {
+    // header, see TableHeader
     uint64_t                id = 0;
     uint64_t                game_id = std::numeric_limits<uint64_t>::max();
+    uint8_t                 table_status = T_WAIT_PLAYER;
+    eosio::time_point       last_act_time;
+    uint64_t                timestamp;
+    uint32_t                adaptive_timeout_sec = 0; // TF_ADAPTIVE_TIMEOUT, 0 - global timeouts
+
     eosio::asset            small_blind;
     uint8_t                 max_players = 9; 
     uint8_t                 players_count = 0;
     uint8_t                 rsa_key_flag = 0;
+    uint8_t                 table_flags = 0; // TableFlags
 
     //std::vector<Debug>      debug;
 
     RsaOpenKey              open_key;
 
-    uint8_t                 table_status = T_WAIT_PLAYER;
     uint8_t                 saved_table_status = 0;
 
     uint8_t                 current_game_players_count = 0;
@@ -330,11 +501,14 @@ Table
     uint8_t                 bb_index;
     uint8_t                 next_player_index;
 
-    eosio::time_point       last_act_time;
-    uint64_t                timestamp;
+    uint64_t                events_seq = 0; // next TableEvent seq
+    std::vector<PhaseMark>  phase_marks;    // this hand, saved with the game statistic
 
-    std::vector<uint8_t>    possible_moves;
-    std::vector<eosio::asset> raise_variants;
+    // bits by players indexes, kept by setPlayerStatus and updateSeatMasks
+    uint16_t                occupied_seats = 0; // not P_NO_PLAYER
+    uint16_t                in_game_seats = 0;  // P_IN_GAME
+    uint16_t                in_hand_seats = 0;  // P_IN_GAME, P_FOLD, P_OUT, P_TIMEOUT
+    uint16_t                allin_seats = 0;    // all_in_flag, updateSeatMasks after every act
 
     std::vector<uint8_t>    waiting_keys_indexes;
     std::vector<uint8_t>    table_cards_indexes; // 3, 4 or 5 max
@@ -351,14 +525,24 @@ Table
     std::map<eosio::name, std::vector<Key>> players_rsa_keys;
 
     uint64_t primary_key() const { return id;}
-    uint64_t by_last_act_time() const { return (uint64_t)(last_act_time.elapsed.count());}
+    // waiting and parked tables never expire, keep them at the end of the sweep range
+    uint64_t by_last_act_time() const { return table_status == T_WAIT_PLAYER || table_status == T_PARKED ? std::numeric_limits<uint64_t>::max() : (uint64_t)(last_act_time.elapsed.count());}
+    uint64_t by_parked() const { return table_status == T_PARKED ? (uint64_t)small_blind.amount : std::numeric_limits<uint64_t>::max();}
 
     uint8_t getTableStatus() const;
     void setTableStatus(const uint8_t new_status);
+    void addEvent(uint8_t type, uint8_t player_index, eosio::name name, uint8_t act, eosio::asset amount);
+    void recordLatency(uint8_t player_index);
+    void savePhaseMarks() const;
+    void getPhaseMs(std::vector<uint32_t>& phase_ms) const;
+    void park();
+    void setAdaptiveTimeout();
 
     uint8_t getWaitingKeysCount() const;
-    void addNewKeys(eosio::name name, uint8_t player_index, std::vector<Key> keys);
-    void addFoldKeys(std::vector<Key> keys);
+    void addNewKeys(eosio::name name, uint8_t player_index, std::vector<Key>& keys);
+    void addFoldKeys(std::vector<Key>& keys);
+    std::vector<uint8_t> getNextStreetKeysIndexes() const;
+    void applyPendingKeys(uint8_t player_index, std::vector<Key>& keys);
 
     void addNewPlayer(const eosio::name& name, const eosio::asset& stack, uint8_t wait_for_bb);
     
@@ -366,10 +550,10 @@ Table
     void setEventsFromOutAndFoldPlayers();
     
     void updateOutPlayerCurRoundBets(Player& out_plr, uint8_t plr_index);
-    void out_player(const eosio::name& name, const uint8_t plr_index, std::vector<Key> keys);
+    void out_player(const eosio::name& name, const uint8_t plr_index, std::vector<Key>& keys);
 
     void saveKeys(uint8_t plr_index, std::vector<Key>& keys);
-    void out_player_new(const eosio::name& name, const uint8_t plr_index, std::vector<Key> keys);
+    void out_player_new(const eosio::name& name, const uint8_t plr_index, std::vector<Key>& keys);
 
     void setLastTime();
 
@@ -378,18 +562,22 @@ Table
     void resettableGameStatistic() const;
     void deletetableGameStatistic() const;
 
-    bool checkMaxRaiseValue(const eosio::asset& value);
-    void setRaiseVariants();
-    void setPossibleMoves();
+    BettingState getBettingState(uint8_t player_index) const;
     
     void initTheDeckOfCards();
-    void setNewDeck(const std::vector<Card>& cards);
+    void setNewDeck(std::vector<Card>& cards);
 
     void setNewInGameIndex(uint8_t& index, uint8_t offset);
+
+    void setPlayerStatus(uint8_t index, uint8_t status);
+    void updateSeatMasks(uint8_t index);
+    void rebuildSeatMasks();
+    SeatRotation seatRotation() const;
     void moveDealerIndex();
     void setDealerIndex(bool move_dealer);
     void moveBigBlindIndex(uint8_t& index, uint8_t offset);
     uint8_t setNextPlayerIndex();
+    bool isWaitingAct(uint8_t index) const;
     void jobSetNextPlayerIndex();
 
     void clearGameInfo();
@@ -401,6 +589,8 @@ Table
     bool onlyOnePlayer();
     void cutNoPlayers();
     void initNewGame(bool move_dealer);
+    void nextGame();
+    void startShuffle();
 
     bool checkEndGame() const;
     bool checkEndAllInGame() const;
@@ -413,12 +603,12 @@ Table
 
     void calculateWinners(eosio::asset bank, std::vector<PlayerHistoryInfo>&  players, bool all_in);
 
-    bool decryptCardByOneKey(Card& card, Key& key);
+    bool decryptCardByOneKey(Card& card, const Key& key);
     bool decryptCardByAllKeys(Card& card, int card_index);
     void decryptPlayersCards();
 
     void saveOneWinnerHistory(GameResult& res);
-    void saveAllInHistory(GameResult& res);
+    void saveAllInHistory(GameResult& res, int64_t rake_num, int64_t rake_den);
     void setShowDown(GameResult& res);
 
     void update_players_with_bets();
@@ -427,6 +617,7 @@ Table
     void actMasterBlind();
     void setCardsIndexesToPlayers();
     void actAllInKeys();
+    bool runOutAllIn();
     void actMasterShowDown();
     void addNewAct(Player& player, uint8_t player_index, Act& act);
     void endGame();
@@ -434,13 +625,36 @@ Table
     bool getTimeoutType();
     bool getPenaltyAssetFlag();
     bool isWaitKeys();
-    void setPlayersTimeoutsAndPenalty(bool set_penalty, std::vector<uint8_t>& new_timeout, std::vector<uint8_t>& in_game);
+    void setPlayersTimeoutsAndPenalty(bool set_penalty, std::vector<uint8_t>& new_timeout, std::vector<uint8_t>& in_game, AccountDeltas& deltas);
 
     void setBlackBoxKeys(std::map<eosio::name, std::vector<Key>>& players_keys);
 };
 
 struct [[eosio::table, eosio::contract("pokercontract")]]
 globalstate{
+        std::vector<eosio::asset>  small_blind_values;
+        std::vector<uint8_t>    max_players_count_values;
+        uint8_t                 penalty_percent;
+        eosio::asset            max_penalty_value;
+        uint8_t                 player_pay_percent;
+        uint8_t                 master_pay_percent;
+        uint32_t                rake_bp;
+        eosio::asset            max_rake_value;
+        uint32_t                warning_timeout_sec;
+        uint32_t                last_timeout_sec;
+        uint32_t                delete_table_timeout_sec;
+        uint32_t                delete_tables_count;
+        uint8_t                 freezing;
+        std::string             client_version = "";
+
+        uint32_t                min_sb_buyin;
+        uint32_t                max_sb_buyin;
+        uint32_t                version;
+        eosio::asset            r;
+};
+
+// globalstate before RAKE_BP_VERSION, only for migraterake
+struct globalstate_legacy{
         std::vector<eosio::asset>  small_blind_values;
         std::vector<uint8_t>    max_players_count_values;
         uint8_t                 penalty_percent;
@@ -473,6 +687,24 @@ globalref{
     uint32_t percent = 3;
 };
 
+struct [[eosio::table, eosio::contract("pokercontract")]]
+globalpool{
+    uint32_t pool_size = 0; // parked tables kept per small blind, 0 - erase tables
+};
+
+// rake and fines of one table, folded into globalstate and globalfine by flushrake
+// so hands don't rewrite the global singletons
+struct [[eosio::table, eosio::contract("pokercontract")]]
+RakeShard
+{
+    uint64_t        table_id;
+    eosio::asset    r = eosio::asset(0, EOS_SYMBOL);
+    eosio::asset    u = eosio::asset(0, EOS_SYMBOL);
+    eosio::asset    fine_value = eosio::asset(0, EOS_SYMBOL);
+
+    uint64_t primary_key() const { return table_id;}
+};
+
 struct ComboWin
 {
     uint8_t comboNumber;
@@ -490,14 +722,90 @@ ComboSet
 
 using account_index = multi_index<"accounts"_n, Account>;
 using  table_index =  multi_index<"tables"_n, Table, 
-              indexed_by<"bylasttime"_n, const_mem_fun< Table, uint64_t, &Table::by_last_act_time>>>;
+              indexed_by<"bylasttime"_n, const_mem_fun< Table, uint64_t, &Table::by_last_act_time>>,
+              indexed_by<"byparked"_n, const_mem_fun< Table, uint64_t, &Table::by_parked>>>;
 using  global_state_singleton = singleton<"globalstate"_n, globalstate>;
+using  global_state_legacy_singleton = singleton<"globalstate"_n, globalstate_legacy>;
 using  global_fine_singleton = singleton<"globalfine"_n, globalfine>;
 using  global_ref_singleton = singleton<"globalref"_n, globalref>;
+using  global_pool_singleton = singleton<"globalpool"_n, globalpool>;
+
+#define SWEEP_MAX_TABLES    20  // tables reset by one sweep
+#define SWEEP_MAX_SCAN      100 // rows of bylasttime read by one sweep
+
+// seconds without acts after which the table can be reset
+uint32_t getResetTimeout(const globalstate& gstate, uint8_t table_status, uint32_t adaptive_timeout_sec);
 
 using combos_index = multi_index<"combostbl"_n, ComboSet>;
 
 using statistic_index = multi_index<"gamesstats"_n, GamesStatistic>;
+using statistic_day_index = multi_index<"statsdays"_n, StatisticDay>;
+
+using rake_shard_index = multi_index<"rakeshards"_n, RakeShard>;
+using table_event_index = multi_index<"tableevents"_n, TableEvent>;
+using chat_message_index = multi_index<"chatmsgs"_n, ChatMessage>;
+using table_trace_index = multi_index<"tabletrace"_n, TableTrace>;
+
+// erases up to count rows scoped by the table id, with the table row. Returns the number erased
+uint64_t eraseTableScopes(uint64_t table_id, uint64_t count);
+
+globalstate getDefaultParameters();
+
+// value constructed on first use in raw storage, trivially constructible and destructible:
+// no static initializer and no atexit destructor on every action
+template<typename T>
+struct LazyValue
+{
+    bool    loaded;
+    alignas(T) char data[sizeof(T)];
+
+    T& get() { return *reinterpret_cast<T*>(data); }
+
+    void set(const T& value)
+    {
+        reset();
+        new (data) T(value);
+        loaded = true;
+    }
+
+    // native tools reuse the storage for the next action, the wasm instance is dropped
+    void reset()
+    {
+        if(loaded)
+            get().~T();
+        loaded = false;
+    }
+};
+
+// global singletons read on first use and kept for the rest of the action,
+// so table actions that don't need them don't pay for the reads
+class GlobalCache
+{
+    public:
+        void reset();
+
+        bool stateExists();
+        globalstate& getState();    // default parameters before init
+        globalfine& getFine();
+        globalref& getRef();
+        globalpool& getPool();
+
+        void saveState(eosio::name payer);
+        void saveFine(eosio::name payer);
+
+    private:
+        bool state_exists;
+
+        LazyValue<globalstate> state;
+        LazyValue<globalfine> fine;
+        LazyValue<globalref> ref;
+        LazyValue<globalpool> pool;
+};
+
+static_assert(std::is_trivially_default_constructible<GlobalCache>::value &&
+              std::is_trivially_destructible<GlobalCache>::value, "global_cache must not need a static initializer");
+
+extern CONTRACT_STATE_STORAGE GlobalCache global_cache;
 
 CONTRACT pokercontract : public contract 
 {
@@ -507,54 +815,51 @@ CONTRACT pokercontract : public contract
                         accounts(_self, _self.value),
                         tables(_self, _self.value),
                         global(_self, _self.value),
-                        global_fine(_self, _self.value),
                         global_ref(_self, _self.value)
       {
-        gstate = global.exists() ? global.get() : get_default_parameters();
-
-        if(global_fine.exists())
-            gfine = global_fine.get();
-        else
-        {
-            globalfine gf;
-            global_fine.set(gf, _self);
-            gfine = gf;
-        }
-
-        if(global_ref.exists())
-            gref = global_ref.get();
-        else
-        {
-            globalref gr;
-            global_ref.set(gr, _self);
-            gref = gr;
-        }
+        global_cache.reset();
       }
 
-    bool primary_checks(eosio::name name, uint64_t table_id, uint64_t game_id, uint64_t timestamp, uint32_t trx_index, uint8_t& player_index);
+    bool primary_checks(eosio::name name, uint64_t table_id, uint64_t game_id, uint64_t timestamp, uint8_t& player_index,
+                        const TableHeader* header = nullptr);
+    void autoNextHand(uint64_t table_id);
+    void resetTable(eosio::name name, uint64_t table_id, uint64_t time_elapsed, uint32_t timeout);
+    void releaseTable(table_index::const_iterator itr_tables);
+    uint32_t parkedTablesCount(eosio::asset small_blind, uint32_t max_count);
+    void playerAct(eosio::name name, uint64_t table_id, uint64_t game_id, Act& player_act, std::vector<Key>* keys, uint64_t timestamp);
 
     ACTION init(name owner, std::string client_version);
     ACTION clear(name owner, uint64_t count);
     ACTION clearstats(name owner, uint64_t count);
+    ACTION expirestats(name owner, uint32_t keep_days, uint64_t count);
+    ACTION migratestats(name owner, uint64_t count);
+    ACTION gameresult(uint64_t game_id, eosio::asset small_blind, eosio::asset bank, eosio::asset rake,
+                      uint8_t status, std::vector<uint8_t> data);
     ACTION setparams(eosio::name owner, globalstate& gs);
+    ACTION migraterake(eosio::name owner);
     ACTION setref(eosio::name owner, uint32_t percent);
     ACTION setnewref(eosio::name owner, std::vector<eosio::name> referals, uint32_t new_percent);
+    ACTION setpool(eosio::name owner, uint32_t pool_size);
+    ACTION warmpool(eosio::name owner, eosio::asset small_blind, uint32_t count);
 
     ACTION transfer(name from, name to, asset quantity, std::string memo);
 
     ACTION connecttable(eosio::name name, eosio::asset small_blind, uint8_t max_players, std::vector<uint8_t> client_version, 
-                        uint8_t autorebuy, uint8_t buyin_sb, uint8_t wait_for_bb, uint8_t rsa_key_flag);
+                        uint8_t autorebuy, uint8_t buyin_sb, uint8_t wait_for_bb, uint8_t rsa_key_flag,
+                        eosio::binary_extension<uint8_t> table_flags_ext); // TableFlags, 0 for old clients
     ACTION outfromtable2(eosio::name name, uint64_t table_id, uint64_t game_id, std::vector<Key> keys);
-    ACTION outfromtable(eosio::name name, uint64_t table_id, uint64_t game_id, std::vector<Key> keys);
+    ACTION outfromtable(eosio::name name, uint64_t table_id, uint64_t game_id, std::vector<Key>& keys);
 
-    ACTION shuffleddeck(eosio::name name, uint64_t table_id, uint64_t game_id, std::vector<Card> cards, uint64_t timestamp, uint32_t trx_index);
-    ACTION  crypteddeck(eosio::name name, uint64_t table_id, uint64_t game_id, std::vector<Card> cards, uint64_t timestamp, uint32_t trx_index, 
-                        std::vector<Key> player_rsa_keys);
+    ACTION shuffleddeck(eosio::name name, uint64_t table_id, uint64_t game_id, std::vector<Card>& cards, uint64_t timestamp, uint32_t trx_index);
+    ACTION  crypteddeck(eosio::name name, uint64_t table_id, uint64_t game_id, std::vector<Card>& cards, uint64_t timestamp, uint32_t trx_index, 
+                        std::vector<Key>& player_rsa_keys);
     ACTION          act(eosio::name name, uint64_t table_id, uint64_t game_id, Act act, uint64_t timestamp, uint32_t trx_index);
-    ACTION      actfold(eosio::name name, uint64_t table_id, uint64_t game_id, std::vector<Key> keys, uint64_t timestamp, uint32_t trx_index);
-    ACTION setcardskeys(eosio::name name, uint64_t table_id, uint64_t game_id, std::vector<Key> keys, uint64_t timestamp, uint32_t trx_index);
-    ACTION   setrsakeys(eosio::name name, uint64_t table_id, uint64_t game_id, std::map<eosio::name, std::vector<Key>> players_keys);
+    ACTION  actwithkeys(eosio::name name, uint64_t table_id, uint64_t game_id, Act act, std::vector<Key>& keys, uint64_t timestamp, uint32_t trx_index);
+    ACTION      actfold(eosio::name name, uint64_t table_id, uint64_t game_id, std::vector<Key>& keys, uint64_t timestamp, uint32_t trx_index);
+    ACTION setcardskeys(eosio::name name, uint64_t table_id, uint64_t game_id, std::vector<Key>& keys, uint64_t timestamp, uint32_t trx_index);
+    ACTION   setrsakeys(eosio::name name, uint64_t table_id, uint64_t game_id, std::map<eosio::name, std::vector<Key>>& players_keys);
     ACTION   resettable(eosio::name name, uint64_t table_id, uint64_t game_id, uint8_t table_status, uint64_t timestamp, uint32_t trx_index);
+    ACTION        sweep(uint32_t max_count);
     ACTION  sendendgame(eosio::name name, uint64_t table_id, uint64_t game_id, uint64_t timestamp, uint32_t trx_index);
     ACTION  sendnewgame(eosio::name name, uint64_t table_id, uint64_t game_id, uint64_t timestamp, uint32_t trx_index);
 
@@ -576,19 +881,14 @@ CONTRACT pokercontract : public contract
                       );
     ACTION testrake(eosio::name name);
     ACTION cleargamesid(eosio::name owner, uint64_t count);
+    ACTION flushrake(eosio::name name, uint64_t count);
 
 private:
     account_index   accounts;
     table_index     tables;
 
     global_state_singleton global;
-    globalstate gstate;
-    global_fine_singleton global_fine;
-    globalfine gfine;
     global_ref_singleton global_ref;
-    globalref gref;
-
-    globalstate get_default_parameters();
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,44 @@
+#!/bin/bash
+
+# Average cpu of contract actions on a local nodeos, to compare two builds of the contract
+# usage: measure_cpu.sh <contract dir> [count] [contract] [action] [data] [actor]
+#
+# Without action pushes transfer with code = contract, which apply() skips without running
+# the contract: the result is the cost of wasm instantiation and static initializers.
+#
+#   measure_cpu.sh ./contracts/pokercontract_old 200 > old.txt
+#   measure_cpu.sh ./contracts/pokercontract 200 > new.txt
+#   measure_cpu.sh ./contracts/pokercontract 200 dcdpcontract sendmsg '["accountnum11", 0, 0, "hi"]' accountnum11
+
+DIR=$1
+COUNT=${2:-100}
+CONTRACT=${3:-dcdpcontract}
+ACTION=${4:-transfer}
+DATA=${5:-'["'$CONTRACT'", "'$CONTRACT'", "0.0001 EOS", "cpu"]'}
+ACTOR=${6:-$CONTRACT}
+
+cleos set contract $CONTRACT $DIR -p $CONTRACT > /dev/null || exit 1
+# next block, so the first measured action doesn't pay for the new code
+sleep 1
+
+TOTAL=0
+DONE=0
+for i in $(seq 1 $COUNT)
+do
+    # unique data, same transaction would be rejected as duplicate
+    US=$(cleos push action $CONTRACT $ACTION "$DATA" -p $ACTOR -f -j --delay-sec 0 -x $((30 + i % 3000)) 2>/dev/null |
+         jq '.processed.action_traces[0].elapsed')
+    if [ -n "$US" ] && [ "$US" != "null" ]
+    then
+        TOTAL=$((TOTAL + US))
+        DONE=$((DONE + 1))
+    fi
+done
+
+if [ $DONE -eq 0 ]
+then
+    echo "no successful actions"
+    exit 1
+fi
+
+printf "%s %s: %d actions, average %d us\n" "$DIR" "$ACTION" $DONE $((TOTAL / DONE))
@@ -0,0 +1,23 @@
+#!/bin/bash
+
+# Records ended games and eosio.token transfers of the contract as a stream for tools/bin/indexer.
+# Both come from the action history (gameresult actions the contract sends itself at the end
+# of a game, and transfers), no get_table_rows on gamesstats.
+# usage: record_stream.sh [contract] [count]
+
+CONTRACT=${1:-dcdpcontract}
+COUNT=${2:-100000}
+
+# "1.2345 EOS" -> 12345
+ASSET_TO_INT='def amount: split(" ")[0] | sub("\\."; "") | tonumber;'
+# uint8[] -> hex
+BYTES_TO_HEX='def hex: if type == "string" then . else map([(./16|floor), (.%16)] | map("0123456789abcdef"[.:.+1]) | join("")) | join("") end;'
+
+cleos get actions $CONTRACT -1 -$COUNT -j | jq -r "$ASSET_TO_INT $BYTES_TO_HEX"'
+    .actions[] | .action_trace.act as $act |
+    if $act.account == "'$CONTRACT'" and $act.name == "gameresult" then
+        ["gamestat", ($act.data.game_id|tostring), ($act.data.small_blind|amount), ($act.data.bank|amount),
+         ($act.data.rake|amount), $act.data.status, ($act.data.data|hex)] | @tsv
+    elif $act.account == "eosio.token" and $act.name == "transfer" then
+        ["transfer", .account_action_seq, $act.data.from, $act.data.to, ($act.data.quantity|amount)] | @tsv
+    else empty end'
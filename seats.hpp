@@ -0,0 +1,49 @@
+#ifndef POKER_CONTRACT_SEATS_H
+#define POKER_CONTRACT_SEATS_H
+
+#include <stdint.h>
+
+// Seat rotation on bitmasks of player indexes, bit i = players[i]. Table keeps one row type
+// for all sizes, so the size is a runtime value: only the mask of all seats depends on it and
+// the functions stay inline. No eosiolib in this file.
+
+#define MIN_SEATS   2
+#define MAX_SEATS   9
+
+struct SeatRotation
+{
+    uint16_t all;
+
+    // max_players of setparams are MIN_SEATS..MAX_SEATS
+    explicit SeatRotation(uint8_t max_players)
+    {
+        if(max_players < MIN_SEATS || max_players > MAX_SEATS)
+            max_players = MAX_SEATS;
+        all = (1u << max_players) - 1;
+    }
+
+    uint8_t count(uint16_t seats) const
+    {
+        return __builtin_popcount(seats & all);
+    }
+
+    // next seat of the mask after index, around the table, index itself if it's the only one
+    uint8_t next(uint16_t seats, uint8_t index) const
+    {
+        seats &= all;
+        uint16_t after = seats & ~((2u << index) - 1);
+        return __builtin_ctz(after != 0 ? after : seats);
+    }
+
+    // offset-th seat after index, index stays if there are less than offset seats
+    void moveTo(uint16_t seats, uint8_t& index, uint8_t offset) const
+    {
+        if(count(seats) < offset)
+            return;
+
+        while(offset--)
+            index = next(seats, index);
+    }
+};
+
+#endif
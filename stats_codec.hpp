@@ -0,0 +1,229 @@
+#ifndef POKER_CONTRACT_STATS_CODEC_H
+#define POKER_CONTRACT_STATS_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// Compact format of one game in GamesStatistic::data.
+// The contract writes it, host tools read it, so no eosiolib in this file.
+//
+// version              1 byte
+// table cards count    1 byte, then one card index per card
+// players count        1 byte, then for every player:
+//      name            8 bytes, little endian eosio::name value
+//      flags           1 byte of PackedStatFlags
+//      winnings        varint
+//      hand            2 card indexes              (PS_HAND)
+//      combo rank      3 bytes, little endian      (PS_COMBO)
+//      side pots count varint, then for every side pot:
+//          bank        zigzag varint, delta with previous side pot bank
+//          win         varint
+
+#define STATS_CODEC_VERSION 1
+#define NO_CARD_INDEX       0xFF
+
+enum PackedStatFlags
+{
+    PS_SHOW     = 0x01,
+    PS_HAND     = 0x02,
+    PS_COMBO    = 0x04,
+    PS_TIMEOUT  = 0x08
+};
+
+struct PackedSidePot
+{
+    int64_t     bank = 0;
+    int64_t     win = 0;
+};
+
+struct PackedPlayerStat
+{
+    uint64_t                    name = 0;
+    uint8_t                     flags = 0;
+    int64_t                     winnings = 0;
+    uint8_t                     hand[2] = {NO_CARD_INDEX, NO_CARD_INDEX};
+    uint32_t                    combo_rank = 0;
+    std::vector<PackedSidePot>  side_pots;
+};
+
+struct PackedGameStat
+{
+    std::vector<uint8_t>            table_cards;
+    std::vector<PackedPlayerStat>   players;
+};
+
+// card index = suit*13 + value-2, fits in 6 bits (0..51)
+inline uint8_t packCardIndex(uint8_t suit, uint8_t value)
+{
+    if(suit > 3 || value < 2 || value > 14)
+        return NO_CARD_INDEX;
+    return suit*13 + value - 2;
+}
+
+inline uint8_t getPackedCardSuit(uint8_t index) { return index / 13; }
+inline uint8_t getPackedCardValue(uint8_t index) { return index % 13 + 2; }
+
+// combo type in bits 20..23, values of five combo cards in bits 16..19 .. 0..3
+// so the bigger rank is the better combination
+inline uint32_t packComboRank(uint8_t type, const uint8_t values[5])
+{
+    uint32_t rank = (uint32_t)(type & 0x0F) << 20;
+    for(int i = 0; i < 5; i++)
+        rank |= (uint32_t)(values[i] & 0x0F) << (16 - i*4);
+    return rank;
+}
+
+inline uint8_t getComboRankType(uint32_t rank) { return (rank >> 20) & 0x0F; }
+inline uint8_t getComboRankValue(uint32_t rank, int i) { return (rank >> (16 - i*4)) & 0x0F; }
+
+inline void writeVarint(std::vector<uint8_t>& out, uint64_t value)
+{
+    while(value >= 0x80)
+    {
+        out.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8_t)value);
+}
+
+inline bool readVarint(const uint8_t*& pos, const uint8_t* end, uint64_t& value)
+{
+    value = 0;
+    for(int shift = 0; shift < 64; shift += 7)
+    {
+        if(pos == end)
+            return false;
+
+        uint8_t byte = *pos++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+inline uint64_t zigzagEncode(int64_t value) { return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63); }
+inline int64_t zigzagDecode(uint64_t value) { return (int64_t)(value >> 1) ^ -(int64_t)(value & 1); }
+
+inline void encodeGameStat(const PackedGameStat& stat, std::vector<uint8_t>& out)
+{
+    out.clear();
+    out.push_back(STATS_CODEC_VERSION);
+
+    out.push_back((uint8_t)stat.table_cards.size());
+    for(uint8_t card_index: stat.table_cards)
+        out.push_back(card_index);
+
+    out.push_back((uint8_t)stat.players.size());
+    for(const PackedPlayerStat& plr: stat.players)
+    {
+        for(int i = 0; i < 8; i++)
+            out.push_back((uint8_t)(plr.name >> (i*8)));
+
+        out.push_back(plr.flags);
+        writeVarint(out, (uint64_t)plr.winnings);
+
+        if(plr.flags & PS_HAND)
+        {
+            out.push_back(plr.hand[0]);
+            out.push_back(plr.hand[1]);
+        }
+
+        if(plr.flags & PS_COMBO)
+        {
+            out.push_back((uint8_t)plr.combo_rank);
+            out.push_back((uint8_t)(plr.combo_rank >> 8));
+            out.push_back((uint8_t)(plr.combo_rank >> 16));
+        }
+
+        writeVarint(out, plr.side_pots.size());
+        int64_t prev_bank = 0;
+        for(const PackedSidePot& pot: plr.side_pots)
+        {
+            writeVarint(out, zigzagEncode(pot.bank - prev_bank));
+            writeVarint(out, (uint64_t)pot.win);
+            prev_bank = pot.bank;
+        }
+    }
+}
+
+inline bool decodeGameStat(const uint8_t* data, size_t size, PackedGameStat& stat)
+{
+    const uint8_t* pos = data;
+    const uint8_t* end = data + size;
+    uint64_t value = 0;
+
+    stat.table_cards.clear();
+    stat.players.clear();
+
+    if(size < 3 || *pos++ != STATS_CODEC_VERSION)
+        return false;
+
+    uint8_t cards_count = *pos++;
+    if(end - pos < cards_count)
+        return false;
+    stat.table_cards.assign(pos, pos + cards_count);
+    pos += cards_count;
+
+    if(pos == end)
+        return false;
+    uint8_t players_count = *pos++;
+
+    for(int p = 0; p < players_count; p++)
+    {
+        PackedPlayerStat plr;
+
+        if(end - pos < 9)
+            return false;
+        for(int i = 0; i < 8; i++)
+            plr.name |= (uint64_t)(*pos++) << (i*8);
+        plr.flags = *pos++;
+
+        if(!readVarint(pos, end, value))
+            return false;
+        plr.winnings = (int64_t)value;
+
+        if(plr.flags & PS_HAND)
+        {
+            if(end - pos < 2)
+                return false;
+            plr.hand[0] = *pos++;
+            plr.hand[1] = *pos++;
+        }
+
+        if(plr.flags & PS_COMBO)
+        {
+            if(end - pos < 3)
+                return false;
+            plr.combo_rank = pos[0] | (pos[1] << 8) | ((uint32_t)pos[2] << 16);
+            pos += 3;
+        }
+
+        uint64_t pots_count = 0;
+        if(!readVarint(pos, end, pots_count) || pots_count > (uint64_t)(end - pos))
+            return false;
+
+        int64_t prev_bank = 0;
+        for(uint64_t i = 0; i < pots_count; i++)
+        {
+            PackedSidePot pot;
+            if(!readVarint(pos, end, value))
+                return false;
+            pot.bank = prev_bank + zigzagDecode(value);
+
+            if(!readVarint(pos, end, value))
+                return false;
+            pot.win = (int64_t)value;
+
+            prev_bank = pot.bank;
+            plr.side_pots.push_back(pot);
+        }
+
+        stat.players.push_back(plr);
+    }
+
+    return pos == end;
+}
+
+#endif //POKER_CONTRACT_STATS_CODEC_H
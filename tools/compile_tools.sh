@@ -0,0 +1,23 @@
+#!/bin/bash
+
+# host tools, plain c++ without eosio.cdt
+
+a=$(ls -l |grep bin |cut -b 1)
+if [ -z $a ]
+then
+	mkdir bin
+fi
+
+g++ -std=c++14 -O2 -o ./bin/statsdecode statsdecode.cpp
+g++ -std=c++14 -O2 -o ./bin/indexer indexer.cpp
+
+# tools running the contract on native_chain.hpp, need eosiolib headers of eosio.cdt
+EOSIO_CDT=${EOSIO_CDT:-/usr/local/eosio.cdt}
+if [ ! -f $EOSIO_CDT/include/eosiolib/multi_index.hpp ]
+then
+	echo "eosio.cdt headers not found in $EOSIO_CDT/include, set EOSIO_CDT to build replay and simulator"
+	exit 1
+fi
+
+g++ -std=c++17 -O2 -Wno-attributes -I$EOSIO_CDT/include -o ./bin/replay replay.cpp
+g++ -std=c++17 -O2 -pthread -Wno-attributes -I$EOSIO_CDT/include -o ./bin/simulator simulator.cpp
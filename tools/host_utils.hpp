@@ -0,0 +1,88 @@
+#ifndef POKER_TOOLS_HOST_UTILS_H
+#define POKER_TOOLS_HOST_UTILS_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// eosio::name <-> string without eosiolib, for host tools only
+
+inline std::string nameToString(uint64_t value)
+{
+    static const char* charmap = ".12345abcdefghijklmnopqrstuvwxyz";
+    std::string str(13, '.');
+
+    uint64_t tmp = value;
+    for(int i = 0; i <= 12; i++)
+    {
+        char c = charmap[tmp & (i == 0 ? 0x0f : 0x1f)];
+        str[12-i] = c;
+        tmp >>= (i == 0 ? 4 : 5);
+    }
+
+    size_t last = str.find_last_not_of('.');
+    if(last == std::string::npos)
+        return "";
+    return str.substr(0, last + 1);
+}
+
+inline uint64_t charToNameValue(char c)
+{
+    if(c >= 'a' && c <= 'z')
+        return (c - 'a') + 6;
+    if(c >= '1' && c <= '5')
+        return (c - '1') + 1;
+    return 0;
+}
+
+inline uint64_t stringToName(const std::string& str)
+{
+    uint64_t value = 0;
+    size_t i = 0;
+    for(; i < str.size() && i < 12; i++)
+        value |= (charToNameValue(str[i]) & 0x1f) << (64 - 5*(i + 1));
+
+    if(i == 12 && str.size() > 12)
+        value |= charToNameValue(str[12]) & 0x0f;
+
+    return value;
+}
+
+inline bool hexToBytes(const std::string& hex, std::vector<uint8_t>& out)
+{
+    out.clear();
+    if(hex.size() % 2 != 0)
+        return false;
+
+    for(size_t i = 0; i < hex.size(); i += 2)
+    {
+        int value = 0;
+        for(size_t j = i; j < i + 2; j++)
+        {
+            char c = hex[j];
+            value <<= 4;
+            if(c >= '0' && c <= '9')
+                value |= c - '0';
+            else if(c >= 'a' && c <= 'f')
+                value |= c - 'a' + 10;
+            else if(c >= 'A' && c <= 'F')
+                value |= c - 'A' + 10;
+            else
+                return false;
+        }
+        out.push_back((uint8_t)value);
+    }
+    return true;
+}
+
+// 4 digits after point like EOS_SYMBOL
+inline std::string amountToString(int64_t amount)
+{
+    std::string sign = amount < 0 ? "-" : "";
+    uint64_t abs_amount = amount < 0 ? -(uint64_t)amount : amount;
+    std::string frac = std::to_string(abs_amount % 10000);
+    frac.insert(0, 4 - frac.size(), '0');
+    return sign + std::to_string(abs_amount / 10000) + "." + frac + " EOS";
+}
+
+#endif //POKER_TOOLS_HOST_UTILS_H
@@ -0,0 +1,437 @@
+// Off-chain indexer of games results and account deltas.
+//
+// Reads a recorded action stream (see scripts/record_stream.sh) and keeps per player and
+// per stake aggregates in an append-only columnar file, so dashboards don't need
+// get_table_rows on gamesstats, tables and accounts.
+//
+// Stream: one tab separated record per line, from the action history of the contract
+//      gamestat <game_id> <small_blind> <bank> <rake> <status> <data hex>   - gameresult action of ended game
+//      transfer <action seq> <from> <to> <amount>                          - eosio.token transfer, amounts in 0.0001 EOS
+// data is empty for dead table resets.
+// Games are deduplicated by game_id and transfers by the account action sequence, so overlapping
+// chunks of the stream can be appended again.
+//
+// Usage:
+//      indexer append  <file> <contract> < stream.tsv
+//      indexer player  <file> [name]
+//      indexer stake   <file> [small_blind]
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+#include "host_utils.hpp"
+#include "../stats_codec.hpp"
+
+#define INDEX_MAGIC         0x58494b50 // "PKIX"
+#define BLOCK_GAMES         1
+#define BLOCK_PLAYERS       2
+#define BLOCK_STAKES        3
+#define BLOCK_CURSOR        4
+
+// same values as ResultGame in pokercontract.hpp
+#define R_IN_GAME           0
+#define R_TIMEOUT_RESET     2
+#define R_DEAD_TABLE_RESET  3
+
+struct PlayerAggregate
+{
+    uint64_t    hands = 0;
+    uint64_t    wins = 0;
+    uint64_t    shows = 0;
+    uint64_t    timeouts = 0;
+    int64_t     winnings = 0;
+    int64_t     deposits = 0;
+    int64_t     withdrawals = 0;
+};
+
+struct StakeAggregate
+{
+    uint64_t    hands = 0;
+    uint64_t    timeout_resets = 0;
+    uint64_t    dead_tables = 0;
+    int64_t     bank = 0;
+    int64_t     rake = 0;
+};
+
+//-----------------------------------------------------------------------------
+// columnar file: sequence of blocks
+//      magic, block type, rows count, then every column as rows count of 8 byte values
+
+static void writeColumn(FILE* file, const std::vector<uint64_t>& column)
+{
+    fwrite(column.data(), sizeof(uint64_t), column.size(), file);
+}
+
+static bool readColumn(FILE* file, uint32_t rows, std::vector<uint64_t>& column)
+{
+    column.resize(rows);
+    return fread(column.data(), sizeof(uint64_t), rows, file) == rows;
+}
+
+static void writeBlock(FILE* file, uint32_t type, const std::vector< std::vector<uint64_t> >& columns)
+{
+    uint32_t header[3] = {INDEX_MAGIC, type, (uint32_t)columns[0].size()};
+    fwrite(header, sizeof(uint32_t), 3, file);
+    for(const std::vector<uint64_t>& column: columns)
+        writeColumn(file, column);
+}
+
+static uint32_t getColumnsCount(uint32_t type)
+{
+    switch(type)
+    {
+        case BLOCK_GAMES:   return 1;
+        case BLOCK_PLAYERS: return 8;
+        case BLOCK_STAKES:  return 6;
+        case BLOCK_CURSOR:  return 1;
+    }
+    return 0;
+}
+
+// folds all delta rows of the file into aggregates
+static bool loadIndex(const std::string& path,
+                      uint64_t& transfer_seq,
+                      std::set<uint64_t>& games,
+                      std::map<uint64_t, PlayerAggregate>& players,
+                      std::map<uint64_t, StakeAggregate>& stakes)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if(file == NULL)
+        return true; // new index
+
+    uint32_t header[3];
+    std::vector< std::vector<uint64_t> > columns;
+    bool ok = true;
+
+    while(fread(header, sizeof(uint32_t), 3, file) == 3)
+    {
+        uint32_t columns_count = getColumnsCount(header[1]);
+        if(header[0] != INDEX_MAGIC || columns_count == 0)
+        {
+            ok = false;
+            break;
+        }
+
+        columns.resize(columns_count);
+        for(uint32_t c = 0; c < columns_count; c++)
+            if(!readColumn(file, header[2], columns[c]))
+            {
+                ok = false;
+                break;
+            }
+        if(!ok)
+            break;
+
+        for(uint32_t row = 0; row < header[2]; row++)
+        {
+            if(header[1] == BLOCK_CURSOR)
+            {
+                transfer_seq = std::max(transfer_seq, columns[0][row]);
+            }
+            else if(header[1] == BLOCK_GAMES)
+            {
+                games.insert(columns[0][row]);
+            }
+            else if(header[1] == BLOCK_PLAYERS)
+            {
+                PlayerAggregate& plr = players[columns[0][row]];
+                plr.hands       += columns[1][row];
+                plr.wins        += columns[2][row];
+                plr.shows       += columns[3][row];
+                plr.timeouts    += columns[4][row];
+                plr.winnings    += (int64_t)columns[5][row];
+                plr.deposits    += (int64_t)columns[6][row];
+                plr.withdrawals += (int64_t)columns[7][row];
+            }
+            else
+            {
+                StakeAggregate& stake = stakes[columns[0][row]];
+                stake.hands          += columns[1][row];
+                stake.timeout_resets += columns[2][row];
+                stake.dead_tables    += columns[3][row];
+                stake.bank           += (int64_t)columns[4][row];
+                stake.rake           += (int64_t)columns[5][row];
+            }
+        }
+    }
+
+    fclose(file);
+    return ok;
+}
+
+static void appendIndex(const std::string& path,
+                        uint64_t transfer_seq,
+                        const std::vector<uint64_t>& new_games,
+                        const std::map<uint64_t, PlayerAggregate>& players,
+                        const std::map<uint64_t, StakeAggregate>& stakes)
+{
+    FILE* file = fopen(path.c_str(), "ab");
+    if(file == NULL)
+    {
+        std::cerr << "can't open " << path << std::endl;
+        return;
+    }
+
+    writeBlock(file, BLOCK_CURSOR, {{transfer_seq}});
+
+    if(!new_games.empty())
+        writeBlock(file, BLOCK_GAMES, {new_games});
+
+    if(!players.empty())
+    {
+        std::vector< std::vector<uint64_t> > columns(getColumnsCount(BLOCK_PLAYERS));
+        for(const auto& it: players)
+        {
+            columns[0].push_back(it.first);
+            columns[1].push_back(it.second.hands);
+            columns[2].push_back(it.second.wins);
+            columns[3].push_back(it.second.shows);
+            columns[4].push_back(it.second.timeouts);
+            columns[5].push_back((uint64_t)it.second.winnings);
+            columns[6].push_back((uint64_t)it.second.deposits);
+            columns[7].push_back((uint64_t)it.second.withdrawals);
+        }
+        writeBlock(file, BLOCK_PLAYERS, columns);
+    }
+
+    if(!stakes.empty())
+    {
+        std::vector< std::vector<uint64_t> > columns(getColumnsCount(BLOCK_STAKES));
+        for(const auto& it: stakes)
+        {
+            columns[0].push_back(it.first);
+            columns[1].push_back(it.second.hands);
+            columns[2].push_back(it.second.timeout_resets);
+            columns[3].push_back(it.second.dead_tables);
+            columns[4].push_back((uint64_t)it.second.bank);
+            columns[5].push_back((uint64_t)it.second.rake);
+        }
+        writeBlock(file, BLOCK_STAKES, columns);
+    }
+
+    fclose(file);
+}
+
+//-----------------------------------------------------------------------------
+
+// empty fields are kept, the last one too
+static std::vector<std::string> splitRecord(const std::string& line)
+{
+    std::vector<std::string> fields;
+    if(line.empty())
+        return fields;
+
+    size_t start = 0;
+    while(true)
+    {
+        size_t tab = line.find('\t', start);
+        fields.push_back(line.substr(start, tab == std::string::npos ? std::string::npos : tab - start));
+        if(tab == std::string::npos)
+            break;
+        start = tab + 1;
+    }
+    return fields;
+}
+
+static bool applyGameStat(const std::vector<std::string>& fields,
+                          std::set<uint64_t>& games, std::vector<uint64_t>& new_games,
+                          std::map<uint64_t, PlayerAggregate>& players,
+                          std::map<uint64_t, StakeAggregate>& stakes)
+{
+    if(fields.size() != 7)
+        return false;
+
+    // whole record is parsed before any aggregate changes, a rejected record leaves no trace
+    uint64_t game_id = std::stoull(fields[1]);
+    uint64_t small_blind = std::stoull(fields[2]);
+    int64_t bank = std::stoll(fields[3]);
+    int64_t rake = std::stoll(fields[4]);
+    uint8_t status = (uint8_t)std::stoul(fields[5]);
+    if(status == R_IN_GAME)
+        return true; // will come again when the game ends
+
+    std::vector<uint8_t> data;
+    PackedGameStat stat;
+    if(!hexToBytes(fields[6], data))
+        return false;
+    if(!(data.empty() && status == R_DEAD_TABLE_RESET) && !decodeGameStat(data.data(), data.size(), stat))
+        return false;
+
+    if(!games.insert(game_id).second)
+        return true; // already indexed, stream may be replayed
+
+    StakeAggregate& stake = stakes[small_blind];
+    stake.hands++;
+    stake.bank += bank;
+    stake.rake += rake;
+    if(status == R_TIMEOUT_RESET)
+        stake.timeout_resets++;
+    else if(status == R_DEAD_TABLE_RESET)
+        stake.dead_tables++;
+
+    for(const PackedPlayerStat& packed: stat.players)
+    {
+        PlayerAggregate& plr = players[packed.name];
+        if(packed.flags & PS_TIMEOUT)
+        {
+            plr.timeouts++;
+            continue;
+        }
+
+        plr.hands++;
+        plr.winnings += packed.winnings;
+        if(packed.winnings != 0)
+            plr.wins++;
+        if(packed.flags & PS_SHOW)
+            plr.shows++;
+    }
+
+    new_games.push_back(game_id);
+    return true;
+}
+
+static bool applyTransfer(const std::vector<std::string>& fields, uint64_t contract,
+                          uint64_t& transfer_seq,
+                          std::map<uint64_t, PlayerAggregate>& players)
+{
+    if(fields.size() < 5)
+        return false;
+
+    uint64_t seq = std::stoull(fields[1]);
+    uint64_t from = stringToName(fields[2]);
+    uint64_t to = stringToName(fields[3]);
+    int64_t amount = std::stoll(fields[4]);
+
+    if(seq <= transfer_seq)
+        return true; // already indexed
+    transfer_seq = seq;
+
+    if(to == contract && from != contract)
+        players[from].deposits += amount;
+    else if(from == contract && to != contract)
+        players[to].withdrawals += amount;
+
+    return true;
+}
+
+static int appendStream(const std::string& path, const std::string& contract_name)
+{
+    uint64_t transfer_seq = 0;
+    std::set<uint64_t> games;
+    std::map<uint64_t, PlayerAggregate> all_players;
+    std::map<uint64_t, StakeAggregate> all_stakes;
+
+    if(!loadIndex(path, transfer_seq, games, all_players, all_stakes))
+    {
+        std::cerr << "broken index file " << path << std::endl;
+        return 1;
+    }
+
+    uint64_t contract = stringToName(contract_name);
+    std::vector<uint64_t> new_games;
+    std::map<uint64_t, PlayerAggregate> players;
+    std::map<uint64_t, StakeAggregate> stakes;
+    std::string line;
+    uint64_t records = 0, errors = 0;
+
+    while(std::getline(std::cin, line))
+    {
+        std::vector<std::string> fields = splitRecord(line);
+        if(fields.empty())
+            continue;
+
+        bool ok = false;
+        try
+        {
+            if(fields[0] == "gamestat")
+                ok = applyGameStat(fields, games, new_games, players, stakes);
+            else if(fields[0] == "transfer")
+                ok = applyTransfer(fields, contract, transfer_seq, players);
+        }
+        catch(const std::exception&)
+        {
+            ok = false;
+        }
+
+        if(ok)
+            records++;
+        else
+        {
+            std::cerr << "skip record: " << line << std::endl;
+            errors++;
+        }
+    }
+
+    appendIndex(path, transfer_seq, new_games, players, stakes);
+    std::cerr << records << " records, " << new_games.size() << " new games, " << errors << " skipped" << std::endl;
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+
+static void printPlayer(uint64_t name, const PlayerAggregate& plr)
+{
+    std::cout << nameToString(name) << "\thands=" << plr.hands << "\twins=" << plr.wins
+              << "\tshows=" << plr.shows << "\ttimeouts=" << plr.timeouts
+              << "\twinnings=" << amountToString(plr.winnings)
+              << "\tdeposits=" << amountToString(plr.deposits)
+              << "\twithdrawals=" << amountToString(plr.withdrawals) << std::endl;
+}
+
+static void printStake(uint64_t small_blind, const StakeAggregate& stake)
+{
+    std::cout << amountToString(small_blind) << "\thands=" << stake.hands
+              << "\ttimeout_resets=" << stake.timeout_resets << "\tdead_tables=" << stake.dead_tables
+              << "\tbank=" << amountToString(stake.bank) << "\trake=" << amountToString(stake.rake) << std::endl;
+}
+
+static int query(const std::string& what, const std::string& path, const std::string& key)
+{
+    uint64_t transfer_seq = 0;
+    std::set<uint64_t> games;
+    std::map<uint64_t, PlayerAggregate> players;
+    std::map<uint64_t, StakeAggregate> stakes;
+
+    if(!loadIndex(path, transfer_seq, games, players, stakes))
+    {
+        std::cerr << "broken index file " << path << std::endl;
+        return 1;
+    }
+
+    if(what == "player")
+    {
+        for(const auto& it: players)
+            if(key.empty() || it.first == stringToName(key))
+                printPlayer(it.first, it.second);
+    }
+    else
+    {
+        for(const auto& it: stakes)
+            if(key.empty() || it.first == std::stoull(key))
+                printStake(it.first, it.second);
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    std::string command = argc > 1 ? argv[1] : "";
+
+    if(command == "append" && argc == 4)
+        return appendStream(argv[2], argv[3]);
+
+    if((command == "player" || command == "stake") && (argc == 3 || argc == 4))
+        return query(command, argv[2], argc == 4 ? argv[3] : "");
+
+    std::cerr << "usage: indexer append <file> <contract> < stream.tsv" << std::endl
+              << "       indexer player <file> [name]" << std::endl
+              << "       indexer stake  <file> [small_blind amount]" << std::endl;
+    return 1;
+}
@@ -0,0 +1,683 @@
+#ifndef POKER_TOOLS_NATIVE_CHAIN_H
+#define POKER_TOOLS_NATIVE_CHAIN_H
+
+// In-memory chain for running the contract natively on the host.
+// Implements the eosiolib intrinsics the contract uses (database, auth, time, action data,
+// inline actions, asserts, prints), so a host tool can include pokercontract.cpp
+// and call its apply() like nodeos does.
+//
+// The state is thread_local: every thread is a separate chain, so tools can run
+// independent tables on all cores without locks.
+//
+// Must be included after pokercontract.cpp, the definitions below have to match
+// the eosiolib declarations.
+
+#include <stdint.h>
+#include <string.h>
+#include <map>
+#include <limits>
+#include <iterator>
+#include <set>
+#include <tuple>
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+struct NativeAssert : public std::runtime_error
+{
+    NativeAssert(const std::string& msg) : std::runtime_error(msg) {}
+};
+
+struct NativeExit {};
+
+struct NativeRow
+{
+    uint64_t            payer = 0;
+    std::vector<char>   data;
+};
+
+struct NativeTable
+{
+    uint64_t                        table = 0;
+    std::map<uint64_t, NativeRow>   rows;
+};
+
+// secondary uint64_t index, rows ordered by (secondary, primary)
+struct NativeIndex
+{
+    std::set< std::pair<uint64_t, uint64_t> >  rows;
+    std::map<uint64_t, uint64_t>                secondary_by_primary;
+};
+
+struct NativeIterator
+{
+    int32_t     id;
+    uint64_t    primary;
+    uint64_t    secondary;
+};
+
+// row state before the change, to roll back a failed action
+struct NativeUndo
+{
+    bool        index;
+    int32_t     id;
+    uint64_t    primary;
+    bool        existed;
+    NativeRow   row;
+    uint64_t    secondary;
+};
+
+struct NativeInlineAction
+{
+    std::vector<char>   data;
+};
+
+struct NativeRowSize
+{
+    uint64_t    writes = 0;
+    uint64_t    bytes = 0;
+    uint32_t    max_size = 0;
+};
+
+struct NativeChain
+{
+    uint64_t                    receiver = 0;
+    uint64_t                    now_us = 0;
+    std::set<uint64_t>          auths;
+    std::vector<char>           action_data;
+
+    std::map<std::tuple<uint64_t, uint64_t, uint64_t>, int32_t> table_ids;
+    std::vector<NativeTable>    tables;
+    std::map<std::tuple<uint64_t, uint64_t, uint64_t>, int32_t> index_ids;
+    std::vector<NativeIndex>    indexes;
+
+    // valid while one action runs
+    std::vector<NativeIterator> iterators;
+    std::vector<NativeIterator> index_iterators;
+    std::vector<NativeUndo>     undo;
+
+    std::vector<NativeInlineAction> inline_actions;
+
+    // by table name
+    std::map<uint64_t, NativeRowSize> row_sizes;
+    uint64_t                    db_reads = 0;
+    uint64_t                    db_writes = 0;
+};
+
+thread_local NativeChain native_chain;
+
+// end iterator of table id is -(id + 2), -1 is "no such table"
+inline int32_t nativeEndIterator(int32_t id) { return -(id + 2); }
+inline int32_t nativeIdFromEnd(int32_t iterator) { return -iterator - 2; }
+
+inline int32_t findNativeTable(uint64_t code, uint64_t scope, uint64_t table, bool create)
+{
+    auto key = std::make_tuple(code, scope, table);
+    auto it = native_chain.table_ids.find(key);
+    if(it != native_chain.table_ids.end())
+        return it->second;
+    if(!create)
+        return -1;
+
+    int32_t id = native_chain.tables.size();
+    native_chain.tables.emplace_back();
+    native_chain.tables.back().table = table;
+    native_chain.table_ids[key] = id;
+    return id;
+}
+
+inline int32_t findNativeIndex(uint64_t code, uint64_t scope, uint64_t table, bool create)
+{
+    auto key = std::make_tuple(code, scope, table);
+    auto it = native_chain.index_ids.find(key);
+    if(it != native_chain.index_ids.end())
+        return it->second;
+    if(!create)
+        return -1;
+
+    int32_t id = native_chain.indexes.size();
+    native_chain.indexes.emplace_back();
+    native_chain.index_ids[key] = id;
+    return id;
+}
+
+inline int32_t newNativeIterator(int32_t id, uint64_t primary)
+{
+    native_chain.iterators.push_back({id, primary, 0});
+    return native_chain.iterators.size() - 1;
+}
+
+inline int32_t newNativeIndexIterator(int32_t id, uint64_t secondary, uint64_t primary)
+{
+    native_chain.index_iterators.push_back({id, primary, secondary});
+    return native_chain.index_iterators.size() - 1;
+}
+
+inline void nativeCheck(bool test, const char* msg)
+{
+    if(!test)
+        throw NativeAssert(msg);
+}
+
+inline const NativeIterator& getNativeIterator(int32_t iterator)
+{
+    nativeCheck(iterator >= 0 && iterator < (int32_t)native_chain.iterators.size(), "native chain: invalid iterator");
+    return native_chain.iterators[iterator];
+}
+
+inline const NativeIterator& getNativeIndexIterator(int32_t iterator)
+{
+    nativeCheck(iterator >= 0 && iterator < (int32_t)native_chain.index_iterators.size(), "native chain: invalid index iterator");
+    return native_chain.index_iterators[iterator];
+}
+
+inline void saveNativeUndo(int32_t id, uint64_t primary)
+{
+    NativeUndo undo = {false, id, primary, false, NativeRow(), 0};
+    auto& rows = native_chain.tables[id].rows;
+    auto it = rows.find(primary);
+    if(it != rows.end())
+    {
+        undo.existed = true;
+        undo.row = it->second;
+    }
+    native_chain.undo.push_back(undo);
+}
+
+inline void saveNativeIndexUndo(int32_t id, uint64_t primary)
+{
+    NativeUndo undo = {true, id, primary, false, NativeRow(), 0};
+    auto& secondaries = native_chain.indexes[id].secondary_by_primary;
+    auto it = secondaries.find(primary);
+    if(it != secondaries.end())
+    {
+        undo.existed = true;
+        undo.secondary = it->second;
+    }
+    native_chain.undo.push_back(undo);
+}
+
+inline void rollbackNativeChain()
+{
+    for(auto it = native_chain.undo.rbegin(); it != native_chain.undo.rend(); it++)
+    {
+        if(!it->index)
+        {
+            auto& rows = native_chain.tables[it->id].rows;
+            if(it->existed)
+                rows[it->primary] = it->row;
+            else
+                rows.erase(it->primary);
+            continue;
+        }
+
+        NativeIndex& index = native_chain.indexes[it->id];
+        auto cur = index.secondary_by_primary.find(it->primary);
+        if(cur != index.secondary_by_primary.end())
+        {
+            index.rows.erase(std::make_pair(cur->second, it->primary));
+            index.secondary_by_primary.erase(cur);
+        }
+        if(it->existed)
+        {
+            index.rows.insert(std::make_pair(it->secondary, it->primary));
+            index.secondary_by_primary[it->primary] = it->secondary;
+        }
+    }
+    native_chain.undo.clear();
+}
+
+inline void countNativeRowSize(int32_t id, uint32_t len)
+{
+    NativeRowSize& size = native_chain.row_sizes[native_chain.tables[id].table];
+    size.writes++;
+    size.bytes += len;
+    if(len > size.max_size)
+        size.max_size = len;
+    native_chain.db_writes++;
+}
+
+extern "C" {
+
+//-----------------------------------------------------------------------------
+// primary index
+
+int32_t db_store_i64(uint64_t scope, capi_name table, capi_name payer, uint64_t id, const void* data, uint32_t len)
+{
+    int32_t table_id = findNativeTable(native_chain.receiver, scope, table, true);
+    auto& rows = native_chain.tables[table_id].rows;
+    nativeCheck(rows.find(id) == rows.end(), "native chain: row with primary key already exists");
+
+    saveNativeUndo(table_id, id);
+    NativeRow& row = rows[id];
+    row.payer = payer;
+    row.data.assign((const char*)data, (const char*)data + len);
+    countNativeRowSize(table_id, len);
+
+    return newNativeIterator(table_id, id);
+}
+
+void db_update_i64(int32_t iterator, capi_name payer, const void* data, uint32_t len)
+{
+    const NativeIterator& itr = getNativeIterator(iterator);
+    auto& rows = native_chain.tables[itr.id].rows;
+    auto it = rows.find(itr.primary);
+    nativeCheck(it != rows.end(), "native chain: update of erased row");
+
+    saveNativeUndo(itr.id, itr.primary);
+    if(payer != 0)
+        it->second.payer = payer;
+    it->second.data.assign((const char*)data, (const char*)data + len);
+    countNativeRowSize(itr.id, len);
+}
+
+void db_remove_i64(int32_t iterator)
+{
+    const NativeIterator& itr = getNativeIterator(iterator);
+    saveNativeUndo(itr.id, itr.primary);
+    native_chain.tables[itr.id].rows.erase(itr.primary);
+    native_chain.db_writes++;
+}
+
+int32_t db_get_i64(int32_t iterator, const void* data, uint32_t len)
+{
+    const NativeIterator& itr = getNativeIterator(iterator);
+    auto& rows = native_chain.tables[itr.id].rows;
+    auto it = rows.find(itr.primary);
+    nativeCheck(it != rows.end(), "native chain: read of erased row");
+
+    uint32_t size = it->second.data.size();
+    if(len > 0)
+        memcpy((void*)data, it->second.data.data(), len < size ? len : size);
+    native_chain.db_reads++;
+    return size;
+}
+
+int32_t db_next_i64(int32_t iterator, uint64_t* primary)
+{
+    if(iterator < -1)
+        return -1;
+
+    const NativeIterator& itr = getNativeIterator(iterator);
+    auto& rows = native_chain.tables[itr.id].rows;
+    auto it = rows.upper_bound(itr.primary);
+    if(it == rows.end())
+        return nativeEndIterator(itr.id);
+
+    *primary = it->first;
+    return newNativeIterator(itr.id, it->first);
+}
+
+int32_t db_previous_i64(int32_t iterator, uint64_t* primary)
+{
+    int32_t id = 0;
+    std::map<uint64_t, NativeRow>::iterator it;
+
+    if(iterator < -1)
+    {
+        id = nativeIdFromEnd(iterator);
+        auto& rows = native_chain.tables[id].rows;
+        if(rows.empty())
+            return -1;
+        it = std::prev(rows.end());
+    }
+    else
+    {
+        const NativeIterator& itr = getNativeIterator(iterator);
+        id = itr.id;
+        auto& rows = native_chain.tables[id].rows;
+        it = rows.lower_bound(itr.primary);
+        if(it == rows.begin())
+            return -1;
+        it--;
+    }
+
+    *primary = it->first;
+    return newNativeIterator(id, it->first);
+}
+
+int32_t db_find_i64(capi_name code, uint64_t scope, capi_name table, uint64_t id)
+{
+    int32_t table_id = findNativeTable(code, scope, table, false);
+    if(table_id < 0)
+        return -1;
+
+    auto& rows = native_chain.tables[table_id].rows;
+    if(rows.find(id) == rows.end())
+        return nativeEndIterator(table_id);
+    return newNativeIterator(table_id, id);
+}
+
+int32_t db_lowerbound_i64(capi_name code, uint64_t scope, capi_name table, uint64_t id)
+{
+    int32_t table_id = findNativeTable(code, scope, table, false);
+    if(table_id < 0)
+        return -1;
+
+    auto& rows = native_chain.tables[table_id].rows;
+    auto it = rows.lower_bound(id);
+    if(it == rows.end())
+        return nativeEndIterator(table_id);
+    return newNativeIterator(table_id, it->first);
+}
+
+int32_t db_upperbound_i64(capi_name code, uint64_t scope, capi_name table, uint64_t id)
+{
+    int32_t table_id = findNativeTable(code, scope, table, false);
+    if(table_id < 0)
+        return -1;
+
+    auto& rows = native_chain.tables[table_id].rows;
+    auto it = rows.upper_bound(id);
+    if(it == rows.end())
+        return nativeEndIterator(table_id);
+    return newNativeIterator(table_id, it->first);
+}
+
+int32_t db_end_i64(capi_name code, uint64_t scope, capi_name table)
+{
+    int32_t table_id = findNativeTable(code, scope, table, false);
+    if(table_id < 0)
+        return -1;
+    return nativeEndIterator(table_id);
+}
+
+//-----------------------------------------------------------------------------
+// uint64_t secondary index
+
+int32_t db_idx64_store(uint64_t scope, capi_name table, capi_name payer, uint64_t id, const uint64_t* secondary)
+{
+    int32_t index_id = findNativeIndex(native_chain.receiver, scope, table, true);
+    NativeIndex& index = native_chain.indexes[index_id];
+
+    saveNativeIndexUndo(index_id, id);
+    index.rows.insert(std::make_pair(*secondary, id));
+    index.secondary_by_primary[id] = *secondary;
+
+    return newNativeIndexIterator(index_id, *secondary, id);
+}
+
+void db_idx64_update(int32_t iterator, capi_name payer, const uint64_t* secondary)
+{
+    const NativeIterator itr = getNativeIndexIterator(iterator);
+    NativeIndex& index = native_chain.indexes[itr.id];
+
+    saveNativeIndexUndo(itr.id, itr.primary);
+    index.rows.erase(std::make_pair(itr.secondary, itr.primary));
+    index.rows.insert(std::make_pair(*secondary, itr.primary));
+    index.secondary_by_primary[itr.primary] = *secondary;
+    native_chain.index_iterators[iterator].secondary = *secondary;
+}
+
+void db_idx64_remove(int32_t iterator)
+{
+    const NativeIterator& itr = getNativeIndexIterator(iterator);
+    NativeIndex& index = native_chain.indexes[itr.id];
+
+    saveNativeIndexUndo(itr.id, itr.primary);
+    index.rows.erase(std::make_pair(itr.secondary, itr.primary));
+    index.secondary_by_primary.erase(itr.primary);
+}
+
+int32_t db_idx64_next(int32_t iterator, uint64_t* primary)
+{
+    if(iterator < -1)
+        return -1;
+
+    const NativeIterator itr = getNativeIndexIterator(iterator);
+    NativeIndex& index = native_chain.indexes[itr.id];
+    auto it = index.rows.upper_bound(std::make_pair(itr.secondary, itr.primary));
+    if(it == index.rows.end())
+        return nativeEndIterator(itr.id);
+
+    *primary = it->second;
+    return newNativeIndexIterator(itr.id, it->first, it->second);
+}
+
+int32_t db_idx64_previous(int32_t iterator, uint64_t* primary)
+{
+    int32_t id = 0;
+    std::set< std::pair<uint64_t, uint64_t> >::iterator it;
+
+    if(iterator < -1)
+    {
+        id = nativeIdFromEnd(iterator);
+        NativeIndex& index = native_chain.indexes[id];
+        if(index.rows.empty())
+            return -1;
+        it = std::prev(index.rows.end());
+    }
+    else
+    {
+        const NativeIterator itr = getNativeIndexIterator(iterator);
+        id = itr.id;
+        NativeIndex& index = native_chain.indexes[id];
+        it = index.rows.lower_bound(std::make_pair(itr.secondary, itr.primary));
+        if(it == index.rows.begin())
+            return -1;
+        it--;
+    }
+
+    *primary = it->second;
+    return newNativeIndexIterator(id, it->first, it->second);
+}
+
+int32_t db_idx64_find_primary(capi_name code, uint64_t scope, capi_name table, uint64_t* secondary, uint64_t primary)
+{
+    int32_t index_id = findNativeIndex(code, scope, table, false);
+    if(index_id < 0)
+        return -1;
+
+    NativeIndex& index = native_chain.indexes[index_id];
+    auto it = index.secondary_by_primary.find(primary);
+    if(it == index.secondary_by_primary.end())
+        return nativeEndIterator(index_id);
+
+    *secondary = it->second;
+    return newNativeIndexIterator(index_id, it->second, primary);
+}
+
+int32_t db_idx64_find_secondary(capi_name code, uint64_t scope, capi_name table, const uint64_t* secondary, uint64_t* primary)
+{
+    int32_t index_id = findNativeIndex(code, scope, table, false);
+    if(index_id < 0)
+        return -1;
+
+    NativeIndex& index = native_chain.indexes[index_id];
+    auto it = index.rows.lower_bound(std::make_pair(*secondary, (uint64_t)0));
+    if(it == index.rows.end() || it->first != *secondary)
+        return nativeEndIterator(index_id);
+
+    *primary = it->second;
+    return newNativeIndexIterator(index_id, it->first, it->second);
+}
+
+int32_t db_idx64_lowerbound(capi_name code, uint64_t scope, capi_name table, uint64_t* secondary, uint64_t* primary)
+{
+    int32_t index_id = findNativeIndex(code, scope, table, false);
+    if(index_id < 0)
+        return -1;
+
+    NativeIndex& index = native_chain.indexes[index_id];
+    auto it = index.rows.lower_bound(std::make_pair(*secondary, (uint64_t)0));
+    if(it == index.rows.end())
+        return nativeEndIterator(index_id);
+
+    *secondary = it->first;
+    *primary = it->second;
+    return newNativeIndexIterator(index_id, it->first, it->second);
+}
+
+int32_t db_idx64_upperbound(capi_name code, uint64_t scope, capi_name table, uint64_t* secondary, uint64_t* primary)
+{
+    int32_t index_id = findNativeIndex(code, scope, table, false);
+    if(index_id < 0)
+        return -1;
+
+    NativeIndex& index = native_chain.indexes[index_id];
+    auto it = index.rows.upper_bound(std::make_pair(*secondary, std::numeric_limits<uint64_t>::max()));
+    if(it == index.rows.end())
+        return nativeEndIterator(index_id);
+
+    *secondary = it->first;
+    *primary = it->second;
+    return newNativeIndexIterator(index_id, it->first, it->second);
+}
+
+int32_t db_idx64_end(capi_name code, uint64_t scope, capi_name table)
+{
+    int32_t index_id = findNativeIndex(code, scope, table, false);
+    if(index_id < 0)
+        return -1;
+    return nativeEndIterator(index_id);
+}
+
+//-----------------------------------------------------------------------------
+// action, auth, time
+
+uint32_t read_action_data(void* msg, uint32_t len)
+{
+    uint32_t size = native_chain.action_data.size();
+    if(len > size)
+        len = size;
+    memcpy(msg, native_chain.action_data.data(), len);
+    return len;
+}
+
+uint32_t action_data_size()
+{
+    return native_chain.action_data.size();
+}
+
+void require_auth(capi_name name)
+{
+    nativeCheck(native_chain.auths.count(name) != 0, "missing authority");
+}
+
+void require_auth2(capi_name name, capi_name permission)
+{
+    nativeCheck(native_chain.auths.count(name) != 0, "missing authority");
+}
+
+bool has_auth(capi_name name)
+{
+    return native_chain.auths.count(name) != 0;
+}
+
+bool is_account(capi_name name)
+{
+    return true;
+}
+
+void require_recipient(capi_name name)
+{
+}
+
+capi_name current_receiver()
+{
+    return native_chain.receiver;
+}
+
+uint64_t current_time()
+{
+    return native_chain.now_us;
+}
+
+// inline actions are only recorded, eosio.token is not emulated
+void send_inline(char* serialized_action, size_t size)
+{
+    native_chain.inline_actions.push_back({std::vector<char>(serialized_action, serialized_action + size)});
+}
+
+void send_context_free_inline(char* serialized_action, size_t size)
+{
+    send_inline(serialized_action, size);
+}
+
+//-----------------------------------------------------------------------------
+// asserts and prints
+
+void eosio_assert(uint32_t test, const char* msg)
+{
+    if(!test)
+        throw NativeAssert(msg);
+}
+
+void eosio_assert_message(uint32_t test, const char* msg, uint32_t msg_len)
+{
+    if(!test)
+        throw NativeAssert(std::string(msg, msg_len));
+}
+
+void eosio_assert_code(uint32_t test, uint64_t code)
+{
+    if(!test)
+        throw NativeAssert("assert code " + std::to_string(code));
+}
+
+void eosio_exit(int32_t code)
+{
+    throw NativeExit();
+}
+
+void prints(const char* cstr) {}
+void prints_l(const char* cstr, uint32_t len) {}
+void printi(int64_t value) {}
+void printui(uint64_t value) {}
+void printsf(float value) {}
+void printdf(double value) {}
+void printn(uint64_t name) {}
+void printhex(const void* data, uint32_t datalen) {}
+
+} // extern "C"
+
+//-----------------------------------------------------------------------------
+
+inline void resetNativeChain(uint64_t receiver)
+{
+    native_chain = NativeChain();
+    native_chain.receiver = receiver;
+}
+
+// runs one action like one transaction: the state is rolled back on assert
+// returns empty string or the assert message
+inline std::string applyNativeAction(uint64_t code, uint64_t action, uint64_t actor,
+                                     const std::vector<char>& data, uint64_t now_us)
+{
+    native_chain.now_us = now_us;
+    native_chain.auths = {actor};
+    native_chain.action_data = data;
+    native_chain.iterators.clear();
+    native_chain.index_iterators.clear();
+    native_chain.undo.clear();
+    native_chain.inline_actions.clear();
+
+    std::string error;
+    try
+    {
+        apply(native_chain.receiver, code, action);
+    }
+    catch(const NativeExit&)
+    {
+    }
+    catch(const std::exception& e)
+    {
+        error = e.what();
+        rollbackNativeChain();
+    }
+
+    native_chain.undo.clear();
+    return error;
+}
+
+// contract scope access from tools outside of an action, like loading a snapshot
+inline void beginNativeContext(uint64_t now_us)
+{
+    native_chain.now_us = now_us;
+    native_chain.auths = {native_chain.receiver};
+    native_chain.iterators.clear();
+    native_chain.index_iterators.clear();
+    native_chain.undo.clear();
+}
+
+#endif //POKER_TOOLS_NATIVE_CHAIN_H
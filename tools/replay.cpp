@@ -0,0 +1,244 @@
+// Deterministic replay of recorded hands through the real contract code.
+//
+// Loads a snapshot of contract tables, then applies recorded actions one by one through
+// the contract apply() on the in-memory chain of native_chain.hpp and prints the state of
+// the tables after every step. A failed action is rolled back like on chain.
+//
+// Snapshot: one row per line, packed rows as returned by get_table_rows with "json": false
+//      <table> <scope> <hex>       table is tables, accounts, globalstate, globalfine or globalref
+//
+//      cleos get table -b dcdpcontract dcdpcontract tables | jq -r '.rows[] | "tables\tdcdpcontract\t" + .'
+//
+// Actions: one action per line, hex_data as in action traces
+//      <time us> <code> <action> <actor> <hex data>
+//
+//      cleos get actions dcdpcontract -1 -1000 -j | jq -r '.actions[].action_trace |
+//          [(.block_time + "Z" | sub("\\.[0-9]+Z"; "Z") | fromdate * 1000000), .act.account, .act.name,
+//           .act.authorization[0].actor, .act.hex_data] | @tsv'
+//
+// Usage:
+//      replay <snapshot> <actions> [-q] [-x] [-s]
+//          -q  no state output, only totals
+//          -x  print packed table rows
+//          -s  stop on the first failed action
+
+#include "../pokercontract.cpp"
+#include "native_chain.hpp"
+#include "host_utils.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+
+struct ReplayAction
+{
+    uint64_t            time_us;
+    uint64_t            code;
+    uint64_t            action;
+    uint64_t            actor;
+    std::vector<char>   data;
+};
+
+static std::vector<std::string> splitRecord(const std::string& line)
+{
+    std::vector<std::string> fields;
+    std::stringstream stream(line);
+    std::string field;
+    while(std::getline(stream, field, '\t'))
+        fields.push_back(field);
+    return fields;
+}
+
+static bool hexToChars(const std::string& hex, std::vector<char>& out)
+{
+    std::vector<uint8_t> bytes;
+    if(!hexToBytes(hex, bytes))
+        return false;
+    out.assign(bytes.begin(), bytes.end());
+    return true;
+}
+
+static std::string charsToHex(const std::vector<char>& data)
+{
+    static const char* digits = "0123456789abcdef";
+    std::string hex;
+    for(char c: data)
+    {
+        hex.push_back(digits[(uint8_t)c >> 4]);
+        hex.push_back(digits[(uint8_t)c & 0x0F]);
+    }
+    return hex;
+}
+
+static bool loadSnapshotRow(const std::string& table, uint64_t scope, const std::vector<char>& data)
+{
+    eosio::name self(CONTRACTNAME);
+
+    if(table == "tables")
+    {
+        Table row = eosio::unpack<Table>(data);
+        table_index tables(self, scope);
+        tables.emplace(self, [&](auto& t){ t = row; });
+    }
+    else if(table == "accounts")
+    {
+        Account row = eosio::unpack<Account>(data);
+        account_index accounts(self, scope);
+        accounts.emplace(self, [&](auto& a){ a = row; });
+    }
+    else if(table == "globalstate")
+        global_state_singleton(self, scope).set(eosio::unpack<globalstate>(data), self);
+    else if(table == "globalfine")
+        global_fine_singleton(self, scope).set(eosio::unpack<globalfine>(data), self);
+    else if(table == "globalref")
+        global_ref_singleton(self, scope).set(eosio::unpack<globalref>(data), self);
+    else
+        return false;
+
+    return true;
+}
+
+static bool loadSnapshot(const std::string& path)
+{
+    std::ifstream file(path);
+    if(!file)
+    {
+        std::cerr << "can't open " << path << std::endl;
+        return false;
+    }
+
+    beginNativeContext(0);
+
+    std::string line;
+    while(std::getline(file, line))
+    {
+        std::vector<std::string> fields = splitRecord(line);
+        std::vector<char> data;
+        if(fields.size() < 3 || !hexToChars(fields[2], data))
+        {
+            std::cerr << "bad snapshot row: " << line << std::endl;
+            return false;
+        }
+
+        try
+        {
+            if(!loadSnapshotRow(fields[0], stringToName(fields[1]), data))
+                std::cerr << "skip snapshot row of " << fields[0] << std::endl;
+        }
+        catch(const std::exception& e)
+        {
+            std::cerr << "bad snapshot row of " << fields[0] << ": " << e.what() << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool loadActions(const std::string& path, std::vector<ReplayAction>& actions)
+{
+    std::ifstream file(path);
+    if(!file)
+    {
+        std::cerr << "can't open " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    while(std::getline(file, line))
+    {
+        std::vector<std::string> fields = splitRecord(line);
+        if(fields.empty())
+            continue;
+
+        ReplayAction act;
+        if(fields.size() < 4 || !hexToChars(fields.size() > 4 ? fields[4] : "", act.data))
+        {
+            std::cerr << "bad action: " << line << std::endl;
+            return false;
+        }
+
+        act.time_us = std::stoull(fields[0]);
+        act.code = stringToName(fields[1]);
+        act.action = stringToName(fields[2]);
+        act.actor = stringToName(fields[3]);
+        actions.push_back(act);
+    }
+    return true;
+}
+
+static void printTables(bool packed)
+{
+    eosio::name self(CONTRACTNAME);
+    table_index tables(self, self.value);
+
+    for(const Table& table: tables)
+    {
+        std::cout << "\ttable=" << table.id << " status=" << (int)table.table_status
+                  << " game=" << table.game_id << " round=" << (int)table.current_game_round
+                  << " bank=" << table.bank.amount << " next=" << (int)table.next_player_index
+                  << " players=";
+
+        for(size_t i = 0; i < table.players.size(); i++)
+        {
+            const Player& plr = table.players[i];
+            std::cout << (i ? "," : "") << nameToString(plr.name.value) << ":" << (int)plr.status
+                      << ":" << plr.stack.amount;
+        }
+
+        if(packed)
+            std::cout << " row=" << charsToHex(eosio::pack(table));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 3)
+    {
+        std::cerr << "usage: replay <snapshot> <actions> [-q] [-x] [-s]" << std::endl;
+        return 1;
+    }
+
+    bool quiet = false, packed = false, stop_on_error = false;
+    for(int i = 3; i < argc; i++)
+    {
+        std::string opt = argv[i];
+        quiet |= opt == "-q";
+        packed |= opt == "-x";
+        stop_on_error |= opt == "-s";
+    }
+
+    resetNativeChain(eosio::name(CONTRACTNAME).value);
+
+    std::vector<ReplayAction> actions;
+    if(!loadSnapshot(argv[1]) || !loadActions(argv[2], actions))
+        return 1;
+
+    uint64_t failed = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for(size_t step = 0; step < actions.size(); step++)
+    {
+        const ReplayAction& act = actions[step];
+        std::string error = applyNativeAction(act.code, act.action, act.actor, act.data, act.time_us);
+        if(!error.empty())
+            failed++;
+
+        if(!quiet)
+        {
+            std::cout << step << "\t" << nameToString(act.action) << "\t" << nameToString(act.actor)
+                      << "\t" << (error.empty() ? "ok" : error);
+            beginNativeContext(act.time_us);
+            printTables(packed);
+            std::cout << std::endl;
+        }
+
+        if(!error.empty() && stop_on_error)
+            break;
+    }
+
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << actions.size() << " actions, " << failed << " failed, "
+              << (sec > 0 ? actions.size() / sec : 0) << " actions/s" << std::endl;
+    return 0;
+}
@@ -0,0 +1,663 @@
+// Multi-table load simulator with bots.
+//
+// Runs N in-memory chains (native_chain.hpp), every chain with several tables of SIM_STAKES stakes
+// and bots driving the real contract actions: connecttable matchmaking across the tables and stakes,
+// shuffleddeck, crypteddeck with the GOST card encryption, setcardskeys, act / actwithkeys / actfold
+// by a random policy, timeouts via resettable, outfromtable and reconnects. Chains are spread over
+// all cores, one chain per worker at a time.
+//
+// Reports actions per second, latency histograms by action and row sizes by table.
+//
+// Usage:
+//      simulator [chains] [hands per table] [threads] [seed] [table flags] [tables per chain]
+//
+// With table flags = 1 (TF_AUTO_NEXT_HAND) the contract starts the next hand by itself,
+// bots don't send sendendgame / sendnewgame and don't leave at the end of a hand.
+//
+// Throughput is the "hands/s" of the time line over all threads, e.g.
+//      simulator 64 200 $(nproc) 1 0 4
+// Not measured yet: it needs a build against the eosio.cdt headers (compile_tools.sh).
+
+#define CONTRACT_STATE_STORAGE thread_local
+#include "../pokercontract.cpp"
+#include "native_chain.hpp"
+#include "host_utils.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+
+#define SIM_CLIENT_VERSION      "simulator"
+#define SIM_HISTOGRAM_SIZE      40      // power of two buckets of nanoseconds
+#define SIM_SEATS               6
+#define SIM_TABLES              4       // tables per chain
+#define SIM_STAKES              2       // small blinds of the first globalstate::small_blind_values
+#define SIM_BENCH               3       // bots waiting for a free seat
+#define SIM_BUYIN_SB            100
+#define SIM_DEPOSIT             100000000
+#define SIM_STEP_US             100000  // virtual time of one action
+#define SIM_MAX_STALLS          3
+#define SIM_FLUSH_HANDS         10      // flushrake period
+
+struct SimPolicy
+{
+    uint32_t    fold_percent = 15;
+    uint32_t    raise_percent = 15;
+    uint32_t    timeout_percent = 2;    // per act
+    uint32_t    leave_percent = 5;      // per hand
+    uint8_t     table_flags = 0;        // TableFlags of connecttable
+};
+
+struct LatencyHistogram
+{
+    uint64_t    buckets[SIM_HISTOGRAM_SIZE] = {};
+    uint64_t    count = 0;
+    uint64_t    total_ns = 0;
+    uint64_t    max_ns = 0;
+
+    void add(uint64_t ns)
+    {
+        int bucket = 0;
+        while((ns >> bucket) > 1 && bucket < SIM_HISTOGRAM_SIZE - 1)
+            bucket++;
+
+        buckets[bucket]++;
+        count++;
+        total_ns += ns;
+        if(ns > max_ns)
+            max_ns = ns;
+    }
+
+    void merge(const LatencyHistogram& other)
+    {
+        for(int i = 0; i < SIM_HISTOGRAM_SIZE; i++)
+            buckets[i] += other.buckets[i];
+        count += other.count;
+        total_ns += other.total_ns;
+        if(other.max_ns > max_ns)
+            max_ns = other.max_ns;
+    }
+
+    // upper bound of the bucket
+    uint64_t percentile(double p) const
+    {
+        uint64_t target = count*p;
+        uint64_t sum = 0;
+        for(int i = 0; i < SIM_HISTOGRAM_SIZE; i++)
+        {
+            sum += buckets[i];
+            if(sum > target)
+                return 2ull << i;
+        }
+        return max_ns;
+    }
+};
+
+struct SimStats
+{
+    uint64_t    actions = 0;
+    uint64_t    failed = 0;
+    uint64_t    hands = 0;
+    uint64_t    timeouts = 0;
+    uint64_t    aborted_chains = 0;
+
+    std::map<uint64_t, LatencyHistogram>    latency; // by action
+    std::map<uint64_t, NativeRowSize>       row_sizes; // by table
+    std::map<std::string, uint64_t>         errors;
+
+    void merge(const SimStats& other)
+    {
+        actions += other.actions;
+        failed += other.failed;
+        hands += other.hands;
+        timeouts += other.timeouts;
+        aborted_chains += other.aborted_chains;
+
+        for(const auto& it: other.latency)
+            latency[it.first].merge(it.second);
+
+        for(const auto& it: other.row_sizes)
+        {
+            NativeRowSize& size = row_sizes[it.first];
+            size.writes += it.second.writes;
+            size.bytes += it.second.bytes;
+            if(it.second.max_size > size.max_size)
+                size.max_size = it.second.max_size;
+        }
+
+        for(const auto& it: other.errors)
+            errors[it.first] += it.second;
+    }
+};
+
+struct Bot
+{
+    eosio::name         name;
+    eosio::asset        small_blind;
+    uint32_t            trx_index = 0;
+    uint64_t            keys_game_id = std::numeric_limits<uint64_t>::max();
+    std::vector<Key>    keys; // by card index
+};
+
+// same as Table::decryptCardByOneKey, gamma encryption is symmetric
+static void cryptCard(Card& card, const Key& key)
+{
+    unsigned char in_data[8];
+    memset(in_data, 0, 8);
+    in_data[0] = card.suit;
+    in_data[1] = card.value;
+
+    unsigned int sync[2];
+    memcpy(&sync[0], &key.s[0], 8);
+
+    unsigned int key_int[8];
+    memcpy(&key_int[0], &key.data[0], 32);
+
+    unsigned char* text = decrypt_data1(in_data, &key_int[0], &sync[0]);
+    card.suit = text[0];
+    card.value = text[1];
+    freeMem(text);
+}
+
+static std::vector<uint8_t> getClientVersion()
+{
+    std::string version = SIM_CLIENT_VERSION;
+    std::vector<uint8_t> client_version(16);
+    for(int i = 0; i < 16; i++)
+        client_version[i] = (i < version.size() ? version[i] : 0) ^ version_hash[i];
+    return client_version;
+}
+
+struct SimChain
+{
+    SimChain(uint32_t seed, uint32_t tables_count, const SimPolicy& policy, SimStats& stats)
+    : tables_count(tables_count), policy(policy), stats(stats), rng(seed)
+    {
+    }
+
+    uint32_t            tables_count;
+    const SimPolicy&    policy;
+    SimStats&           stats;
+    std::mt19937_64     rng;
+
+    eosio::name         self = eosio::name(CONTRACTNAME);
+    uint64_t            now_us = 1000000000000000ull;
+    uint32_t            next_table = 0; // round robin over the tables
+    std::map<uint64_t, uint64_t> last_game_ids; // by table
+    std::map<uint64_t, Bot> bots;
+    std::vector<uint64_t>   bench;
+
+    bool percent(uint32_t value) { return rng() % 100 < value; }
+
+    bool send(uint64_t code, eosio::name action, uint64_t actor, const std::vector<char>& data)
+    {
+        now_us += SIM_STEP_US;
+
+        auto start = std::chrono::steady_clock::now();
+        std::string error = applyNativeAction(code, action.value, actor, data, now_us);
+        uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+        stats.actions++;
+        stats.latency[action.value].add(ns);
+        if(!error.empty())
+        {
+            stats.failed++;
+            stats.errors[nameToString(action.value) + ": " + error]++;
+        }
+        return error.empty();
+    }
+
+    // tables with players, parked and deleted rows are skipped
+    void loadTables(std::vector<Table>& tables)
+    {
+        tables.clear();
+        beginNativeContext(now_us);
+        table_index table_rows(self, self.value);
+        for(const Table& table: table_rows)
+            if(table.table_status != T_PARKED && table.table_status != T_DELETE)
+                tables.push_back(table);
+    }
+
+    void init(uint32_t seats)
+    {
+        resetNativeChain(self.value);
+        send(self.value, "init"_n, self.value, eosio::pack(std::make_tuple(self, std::string(SIM_CLIENT_VERSION))));
+
+        globalstate gstate = global_state_singleton(self, self.value).get();
+        uint32_t stakes = std::min<uint32_t>(SIM_STAKES, gstate.small_blind_values.size());
+
+        for(uint32_t i = 0; i < seats + SIM_BENCH; i++)
+        {
+            Bot bot;
+            bot.name = eosio::name(stringToName("bot" + std::string(1, 'a' + i / 26) + std::string(1, 'a' + i % 26)));
+            bot.small_blind = gstate.small_blind_values[i % stakes];
+            bots[bot.name.value] = bot;
+            bench.push_back(bot.name.value);
+
+            eosio::asset deposit(SIM_DEPOSIT, EOS_SYMBOL);
+            send("eosio.token"_n.value, "transfer"_n, bot.name.value,
+                 eosio::pack(std::make_tuple(bot.name, self, deposit, std::string(""))));
+        }
+    }
+
+    // a benched bot joins when its stake has a free seat, or opens a new table while there are less
+    // than tables_count, connecttable picks the table
+    bool connectBot(const std::vector<Table>& tables)
+    {
+        for(auto itr_bench = bench.begin(); itr_bench != bench.end(); itr_bench++)
+        {
+            Bot& bot = bots[*itr_bench];
+
+            bool free_seat = tables.size() < tables_count;
+            for(const Table& table: tables)
+                if(table.small_blind == bot.small_blind && table.players_count < table.max_players)
+                    free_seat = true;
+
+            if(!free_seat)
+                continue;
+
+            bench.erase(itr_bench);
+
+            uint8_t max_players = SIM_SEATS, autorebuy = 1, buyin_sb = SIM_BUYIN_SB, wait_for_bb = 0, rsa_key_flag = 0;
+            send(self.value, "connecttable"_n, bot.name.value,
+                 eosio::pack(std::make_tuple(bot.name, bot.small_blind, max_players, getClientVersion(),
+                                             autorebuy, buyin_sb, wait_for_bb, rsa_key_flag, policy.table_flags)));
+            return true;
+        }
+        return false;
+    }
+
+    bool sendTableAction(Bot& bot, const Table& table, eosio::name action)
+    {
+        return send(self.value, action, bot.name.value,
+                    eosio::pack(std::make_tuple(bot.name, table.id, table.game_id, table.timestamp, bot.trx_index++)));
+    }
+
+    void shuffleDeck(Bot& bot, const Table& table)
+    {
+        std::vector<Card> cards = table.the_deck_of_cards;
+        std::shuffle(cards.begin(), cards.end(), rng);
+
+        send(self.value, "shuffleddeck"_n, bot.name.value,
+             eosio::pack(std::make_tuple(bot.name, table.id, table.game_id, cards, table.timestamp, bot.trx_index++)));
+    }
+
+    void cryptDeck(Bot& bot, const Table& table)
+    {
+        bot.keys.resize(table.the_deck_of_cards.size());
+        bot.keys_game_id = table.game_id;
+
+        std::vector<Card> cards = table.the_deck_of_cards;
+        for(uint8_t i = 0; i < cards.size(); i++)
+        {
+            Key& key = bot.keys[i];
+            key.card_index = i;
+            key.data.resize(32);
+            key.s.resize(8);
+            for(uint8_t& b: key.data)
+                b = rng();
+            for(uint8_t& b: key.s)
+                b = rng();
+
+            cryptCard(cards[i], key);
+        }
+
+        std::vector<Key> player_rsa_keys;
+        send(self.value, "crypteddeck"_n, bot.name.value,
+             eosio::pack(std::make_tuple(bot.name, table.id, table.game_id, cards, table.timestamp, bot.trx_index++, player_rsa_keys)));
+    }
+
+    void sendCardsKeys(Bot& bot, const Table& table, const Player& plr)
+    {
+        std::vector<Key> keys;
+        uint8_t status = table.table_status;
+
+        if(status == T_WAIT_ALL_KEYS || status == T_WAIT_ALLIN_KEYS)
+        {
+            keys.push_back(bot.keys[plr.cards_indexes[0]]);
+            keys.push_back(bot.keys[plr.cards_indexes[1]]);
+        }
+
+        for(uint8_t index: table.waiting_keys_indexes)
+        {
+            if(status == T_WAIT_KEYS_FOR_PLAYERS && (index == plr.cards_indexes[0] || index == plr.cards_indexes[1]))
+                continue;
+            keys.push_back(bot.keys[index]);
+        }
+
+        send(self.value, "setcardskeys"_n, bot.name.value,
+             eosio::pack(std::make_tuple(bot.name, table.id, table.game_id, keys, table.timestamp, bot.trx_index++)));
+    }
+
+    void fold(Bot& bot, const Table& table)
+    {
+        uint8_t start_index = table.current_game_players_count * 2;
+        if(!table.table_cards_indexes.empty())
+            start_index = table.table_cards_indexes.back() + 1;
+
+        std::vector<Key> keys(bot.keys.begin() + start_index, bot.keys.end());
+        send(self.value, "actfold"_n, bot.name.value,
+             eosio::pack(std::make_tuple(bot.name, table.id, table.game_id, keys, table.timestamp, bot.trx_index++)));
+    }
+
+    // legal moves from moves.hpp, the same the contract validates with
+    void act(Bot& bot, const Table& table, uint8_t plr_index)
+    {
+        BettingState state = table.getBettingState(plr_index);
+        bool can_check = isPossibleMove(state, ACT_CHECK);
+
+        if(!can_check && percent(policy.fold_percent))
+        {
+            fold(bot, table);
+            return;
+        }
+
+        Act player_act(ACT_CHECK, eosio::asset(0, EOS_SYMBOL));
+
+        if(percent(policy.raise_percent))
+        {
+            uint32_t variant = rng() % 4;
+            if(variant >= raiseVariantsCount(state))
+                variant = raiseVariantsCount(state) - 1;
+            player_act = Act(ACT_BET, eosio::asset(raiseVariant(state, variant), EOS_SYMBOL));
+        }
+        else if(!can_check)
+        {
+            int64_t call = state.current_bet < maxBetValue(state) ? state.current_bet : maxBetValue(state);
+            player_act = Act(ACT_BET, eosio::asset(call, EOS_SYMBOL));
+        }
+
+        // the contract takes keys only with the act closing the street, a wrong guess fails and the bot acts without them
+        std::vector<uint8_t> indexes = table.getNextStreetKeysIndexes();
+        if(bot.keys_game_id == table.game_id && !indexes.empty() && closesRound(table, plr_index, player_act, state))
+        {
+            std::vector<Key> keys;
+            for(uint8_t index: indexes)
+                keys.push_back(bot.keys[index]);
+
+            if(send(self.value, "actwithkeys"_n, bot.name.value,
+                    eosio::pack(std::make_tuple(bot.name, table.id, table.game_id, player_act, keys, table.timestamp, bot.trx_index++))))
+                return;
+        }
+
+        send(self.value, "act"_n, bot.name.value,
+             eosio::pack(std::make_tuple(bot.name, table.id, table.game_id, player_act, table.timestamp, bot.trx_index++)));
+    }
+
+    // check or call after which everybody else still betting has matched the bet and used the option,
+    // like setNextPlayerIndex decides. A raise or an all in never closes
+    bool closesRound(const Table& table, uint8_t plr_index, const Act& player_act, const BettingState& state)
+    {
+        if(player_act.bet_.amount > state.current_bet || player_act.bet_.amount >= maxBetValue(state))
+            return false;
+
+        uint8_t betting = 0;
+        for(uint8_t i = 0; i < table.players.size(); i++)
+        {
+            const Player& plr = table.players[i];
+            if(i == plr_index || plr.status != P_IN_GAME || plr.all_in_flag == P_ALL_IN)
+                continue;
+
+            if(plr.count_of_acts == 0 || plr.cur_round_bets.amount != state.current_bet)
+                return false;
+
+            // preflop big blind or extra big blind has the option
+            if(table.current_game_round == 0 && plr.count_of_acts == 1 && (i == table.bb_index || plr.extra_bb_status == 1))
+                return false;
+
+            betting++;
+        }
+        return betting > 0;
+    }
+
+    // the acting player is silent, somebody else resets the table after the timeout
+    bool timeout(const Table& table, uint8_t silent_index)
+    {
+        globalstate gstate = global_state_singleton(self, self.value).get();
+        now_us += (uint64_t)(gstate.warning_timeout_sec + gstate.last_timeout_sec + 6) * 1000000;
+
+        for(uint8_t i = 0; i < table.players.size(); i++)
+        {
+            const Player& plr = table.players[i];
+            if(i == silent_index || plr.status == P_NO_PLAYER || plr.status == P_OUT)
+                continue;
+
+            Bot& bot = bots[plr.name.value];
+            stats.timeouts++;
+            return send(self.value, "resettable"_n, bot.name.value,
+                        eosio::pack(std::make_tuple(bot.name, table.id, table.game_id, table.table_status, table.timestamp, bot.trx_index++)));
+        }
+        return false;
+    }
+
+    void leave(Bot& bot, const Table& table)
+    {
+        std::vector<Key> keys;
+        if(send(self.value, "outfromtable"_n, bot.name.value,
+                eosio::pack(std::make_tuple(bot.name, table.id, table.game_id, keys))))
+            bench.push_back(bot.name.value);
+    }
+
+    // one action: a bot joins, or the bot whose turn it is at the next table acts. False if nobody can act
+    bool step()
+    {
+        std::vector<Table> tables;
+        loadTables(tables);
+        if(connectBot(tables))
+            return true;
+
+        for(uint32_t i = 0; i < tables.size(); i++)
+            if(stepTable(tables[(next_table + i) % tables.size()]))
+            {
+                next_table = (next_table + i + 1) % tables.size();
+                return true;
+            }
+        return false;
+    }
+
+    bool stepTable(const Table& table)
+    {
+        auto itr_last = last_game_ids.find(table.id);
+        if(itr_last == last_game_ids.end() || table.game_id != itr_last->second)
+        {
+            if(itr_last != last_game_ids.end())
+                stats.hands++;
+            last_game_ids[table.id] = table.game_id;
+
+            if(stats.hands % SIM_FLUSH_HANDS == 0)
+            {
+                uint64_t count = 10;
+                send(self.value, "flushrake"_n, self.value, eosio::pack(std::make_tuple(self, count)));
+                return true;
+            }
+        }
+
+        uint8_t status = table.table_status;
+        for(uint8_t i = 0; i < table.players.size(); i++)
+        {
+            const Player& plr = table.players[i];
+            if(plr.status == P_NO_PLAYER)
+                continue;
+
+            Bot& bot = bots[plr.name.value];
+            bool next = i == table.next_player_index;
+            bool waiting = plr.have_event == 0;
+
+            switch(status)
+            {
+                case T_WAIT_START_GAME:
+                    if(plr.status == P_IN_GAME && waiting)
+                    {
+                        sendTableAction(bot, table, "sendnewgame"_n);
+                        return true;
+                    }
+                    break;
+
+                case T_WAIT_SHUFFLE:
+                    if(next)
+                    {
+                        shuffleDeck(bot, table);
+                        return true;
+                    }
+                    break;
+
+                case T_WAIT_CRYPT:
+                    if(next)
+                    {
+                        cryptDeck(bot, table);
+                        return true;
+                    }
+                    break;
+
+                case T_WAIT_KEYS_FOR_PLAYERS:
+                case T_WAIT_KEYS_FOR_SHOWDOWN:
+                case T_WAIT_ALL_KEYS:
+                case T_WAIT_ALLIN_KEYS:
+                    if(plr.status == P_IN_GAME && waiting && bot.keys_game_id == table.game_id)
+                    {
+                        sendCardsKeys(bot, table, plr);
+                        return true;
+                    }
+                    break;
+
+                case T_WAIT_PLAYERS_ACT:
+                    if(next)
+                    {
+                        if(percent(policy.timeout_percent))
+                            return timeout(table, i);
+
+                        act(bot, table, i);
+                        return true;
+                    }
+                    break;
+
+                case T_WAIT_END_GAME:
+                    if((plr.status == P_IN_GAME || plr.status == P_FOLD) && waiting)
+                    {
+                        if(percent(policy.leave_percent))
+                            leave(bot, table);
+                        else
+                            sendTableAction(bot, table, "sendendgame"_n);
+                        return true;
+                    }
+                    break;
+            }
+        }
+        return false;
+    }
+
+    void run(uint32_t hands)
+    {
+        init(SIM_SEATS * tables_count);
+
+        uint32_t stalls = 0;
+        uint64_t start_hands = stats.hands;
+        while(stats.hands - start_hands < (uint64_t)hands * tables_count)
+        {
+            if(step())
+            {
+                stalls = 0;
+                continue;
+            }
+
+            // nobody can act: a seated bot resets a stuck table
+            std::vector<Table> tables;
+            loadTables(tables);
+            bool reset = false;
+            for(const Table& table: tables)
+                if(table.table_status != T_WAIT_PLAYER && timeout(table, table.players.size()))
+                {
+                    reset = true;
+                    break;
+                }
+
+            if(++stalls > SIM_MAX_STALLS || !reset)
+            {
+                stats.aborted_chains++;
+                break;
+            }
+        }
+
+        SimStats chain_stats;
+        chain_stats.row_sizes = native_chain.row_sizes;
+        stats.merge(chain_stats);
+    }
+};
+
+static void printStats(const SimStats& stats, double sec)
+{
+    std::cout << "actions " << stats.actions << ", failed " << stats.failed << ", hands " << stats.hands
+              << ", timeouts " << stats.timeouts << ", aborted chains " << stats.aborted_chains << std::endl;
+    std::cout << std::fixed << std::setprecision(0)
+              << "time " << sec << " s, " << stats.actions / sec << " actions/s, " << stats.hands / sec << " hands/s" << std::endl;
+
+    std::cout << std::endl << "action\tcount\tavg_us\tp50_us\tp90_us\tp99_us\tmax_us" << std::endl << std::setprecision(1);
+    for(const auto& it: stats.latency)
+    {
+        const LatencyHistogram& h = it.second;
+        std::cout << nameToString(it.first) << "\t" << h.count << "\t" << h.total_ns / 1000.0 / h.count
+                  << "\t" << h.percentile(0.5) / 1000.0 << "\t" << h.percentile(0.9) / 1000.0
+                  << "\t" << h.percentile(0.99) / 1000.0 << "\t" << h.max_ns / 1000.0 << std::endl;
+    }
+
+    std::cout << std::endl << "table\twrites\tavg_bytes\tmax_bytes" << std::endl;
+    for(const auto& it: stats.row_sizes)
+        std::cout << nameToString(it.first) << "\t" << it.second.writes << "\t"
+                  << (it.second.writes ? it.second.bytes / it.second.writes : 0) << "\t" << it.second.max_size << std::endl;
+
+    if(!stats.errors.empty())
+    {
+        std::cout << std::endl << "errors" << std::endl;
+        for(const auto& it: stats.errors)
+            std::cout << it.second << "\t" << it.first << std::endl;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t threads_count = std::max(1u, std::thread::hardware_concurrency());
+    uint32_t chains_count = argc > 1 ? std::stoul(argv[1]) : threads_count;
+    uint32_t hands = argc > 2 ? std::stoul(argv[2]) : 1000;
+    if(argc > 3)
+        threads_count = std::stoul(argv[3]);
+    uint32_t seed = argc > 4 ? std::stoul(argv[4]) : 1;
+
+    SimPolicy policy;
+    if(argc > 5)
+        policy.table_flags = std::stoul(argv[5]);
+    uint32_t tables_count = argc > 6 ? std::stoul(argv[6]) : SIM_TABLES;
+
+    SimStats total;
+    std::mutex total_mutex;
+    std::atomic<uint32_t> next_chain(0);
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for(uint32_t t = 0; t < threads_count; t++)
+        workers.emplace_back([&]()
+        {
+            uint32_t chain_number;
+            while((chain_number = next_chain++) < chains_count)
+            {
+                SimStats stats;
+                SimChain chain(seed + chain_number, tables_count, policy, stats);
+                chain.run(hands);
+
+                std::lock_guard<std::mutex> lock(total_mutex);
+                total.merge(stats);
+            }
+        });
+
+    for(std::thread& worker: workers)
+        worker.join();
+
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << chains_count << " chains, " << tables_count << " tables per chain, " << threads_count << " threads" << std::endl;
+    printStats(total, sec);
+    return 0;
+}
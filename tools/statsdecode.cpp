@@ -0,0 +1,90 @@
+// Decodes GamesStatistic::data rows for analytics.
+// Input: one hex string per line (the "data" field of gamesstats from get_table_rows,
+// uint8[] in the abi, so cleos returns it as an array and jq turns it into hex).
+// Output: one JSON object per line.
+//
+// cleos get table dcdpcontract <day> gamesstats -l 100 | jq -r \
+//     'def hex: if type == "string" then . else map([(./16|floor), (.%16)] | map("0123456789abcdef"[.:.+1]) | join("")) | join("") end;
+//      .rows[].data | hex' | ./statsdecode
+
+#include <iostream>
+#include <string>
+#include "host_utils.hpp"
+#include "../stats_codec.hpp"
+
+static const char* combo_names[] =
+{
+    "no_combination", "high_card", "pair", "two_pairs", "three_of_a_kind", "straight",
+    "flush", "full_house", "four_of_a_kind", "straight_flush", "royal_flush"
+};
+
+static std::string cardToString(uint8_t index)
+{
+    static const char* values = "23456789TJQKA";
+    static const char* suits = "shdc";
+    if(index == NO_CARD_INDEX || index > 51)
+        return "??";
+    return std::string(1, values[getPackedCardValue(index) - 2]) + suits[getPackedCardSuit(index)];
+}
+
+static void printGameStat(const PackedGameStat& stat)
+{
+    std::cout << "{\"table_cards\":[";
+    for(size_t i = 0; i < stat.table_cards.size(); i++)
+        std::cout << (i ? "," : "") << "\"" << cardToString(stat.table_cards[i]) << "\"";
+    std::cout << "],\"players\":[";
+
+    for(size_t p = 0; p < stat.players.size(); p++)
+    {
+        const PackedPlayerStat& plr = stat.players[p];
+        std::cout << (p ? "," : "") << "{\"name\":\"" << nameToString(plr.name) << "\""
+                  << ",\"winnings\":\"" << amountToString(plr.winnings) << "\""
+                  << ",\"show\":" << ((plr.flags & PS_SHOW) ? 1 : 0)
+                  << ",\"timeout\":" << ((plr.flags & PS_TIMEOUT) ? 1 : 0);
+
+        if(plr.flags & PS_HAND)
+            std::cout << ",\"hand\":[\"" << cardToString(plr.hand[0]) << "\",\"" << cardToString(plr.hand[1]) << "\"]";
+
+        if(plr.flags & PS_COMBO)
+        {
+            uint8_t type = getComboRankType(plr.combo_rank);
+            std::cout << ",\"combo\":\"" << (type <= 10 ? combo_names[type] : "unknown") << "\""
+                      << ",\"combo_rank\":" << plr.combo_rank;
+        }
+
+        if(!plr.side_pots.empty())
+        {
+            std::cout << ",\"side_pots\":[";
+            for(size_t i = 0; i < plr.side_pots.size(); i++)
+                std::cout << (i ? "," : "") << "{\"bank\":\"" << amountToString(plr.side_pots[i].bank)
+                          << "\",\"win\":\"" << amountToString(plr.side_pots[i].win) << "\"}";
+            std::cout << "]";
+        }
+        std::cout << "}";
+    }
+    std::cout << "]}" << std::endl;
+}
+
+int main()
+{
+    std::string line;
+    std::vector<uint8_t> data;
+    int errors = 0;
+
+    while(std::getline(std::cin, line))
+    {
+        if(line.empty())
+            continue;
+
+        PackedGameStat stat;
+        if(!hexToBytes(line, data) || !decodeGameStat(data.data(), data.size(), stat))
+        {
+            std::cerr << "wrong games statistic data: " << line << std::endl;
+            errors++;
+            continue;
+        }
+        printGameStat(stat);
+    }
+
+    return errors == 0 ? 0 : 1;
+}